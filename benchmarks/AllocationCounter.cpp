@@ -0,0 +1,97 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+std::atomic<uint64_t> g_deallocations{0};
+std::atomic<uint64_t> g_bytes{0};
+
+void* countedAlloc(std::size_t size) {
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	g_bytes.fetch_add(size, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+
+void countedFree(void* p) {
+	if (p) {
+		g_deallocations.fetch_add(1, std::memory_order_relaxed);
+		std::free(p);
+	}
+}
+
+} // namespace
+
+namespace pdebc {
+namespace bench {
+
+AllocationCount allocationCount() {
+	return AllocationCount{g_allocations.load(), g_deallocations.load(), g_bytes.load()};
+}
+
+} // namespace bench
+} // namespace pdebc
+
+void* operator new(std::size_t size) {
+	void* p = countedAlloc(size);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+	countedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+	countedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	countedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	countedFree(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	countedFree(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	countedFree(p);
+}
@@ -0,0 +1,87 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef ALLOCATIONCOUNTER_HPP_
+#define ALLOCATIONCOUNTER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pdebc {
+namespace bench {
+
+//! Heap activity seen by the interposing operator new/delete.
+/*!
+	Linking AllocationCounter.cpp into a program replaces the global
+	operator new and delete (every variant) with versions that count calls
+	from every thread before forwarding to malloc/free.
+*/
+struct AllocationCount {
+	uint64_t allocations;
+	uint64_t deallocations;
+	uint64_t bytes;
+};
+
+//! Totals since the program started.
+AllocationCount allocationCount();
+
+//! Counts the heap activity of named phases.
+/*!
+	Usage:
+		AllocationPhases phases;
+		phases.begin("generation");
+		de.solveOneGeneration();
+		phases.end();
+*/
+struct AllocationPhases {
+	struct Phase {
+		std::string name;
+		AllocationCount count;
+	};
+
+	void begin(const std::string& name) {
+		// reserve first, so our own bookkeeping is not counted
+		phases_.reserve(phases_.size() + 1);
+		current_ = name;
+		start_ = allocationCount();
+	}
+
+	//! Closes the current phase and returns its count.
+	AllocationCount end() {
+		const AllocationCount now = allocationCount();
+		const AllocationCount c{now.allocations - start_.allocations,
+			now.deallocations - start_.deallocations,
+			now.bytes - start_.bytes};
+		phases_.push_back(Phase{current_, c});
+		return c;
+	}
+
+	const std::vector<Phase>& phases() const {
+		return phases_;
+	}
+
+private:
+	std::vector<Phase> phases_;
+	std::string current_;
+	AllocationCount start_;
+};
+
+} // namespace bench
+} // namespace pdebc
+
+#endif /* ALLOCATIONCOUNTER_HPP_ */
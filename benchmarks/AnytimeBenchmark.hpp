@@ -0,0 +1,308 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef ANYTIMEBENCHMARK_HPP_
+#define ANYTIMEBENCHMARK_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "pdebc/SequentialDE.hpp"
+#include "pdebc/ThreadsDE.hpp"
+
+namespace pdebc {
+namespace bench {
+
+//! A solver configuration to benchmark.
+struct Configuration {
+	std::string name;
+	bool threaded; ///< ThreadsDE when true, SequentialDE otherwise.
+	uint32_t n_process; ///< ThreadsDE only.
+	double migration_phi; ///< ThreadsDE only.
+	uint32_t pop_size;
+	double CR;
+	double F;
+};
+
+//! An objective function with a known optimum value of 0.
+template <int DIM>
+struct Problem {
+	std::string name;
+	double domain_limit; ///< Population is generated in [-domain_limit, domain_limit].
+	std::function<double(const std::array<double,DIM>&)> calc_error;
+};
+
+//! Best error found after some effort.
+struct ConvergencePoint {
+	uint64_t evaluations; ///< Error evaluations done so far, including the initial population.
+	double seconds; ///< Wall time since the solver construction started.
+	double best_error;
+};
+
+//! Convergence curve of a single seeded run.
+/*!
+	The first point is taken right after the initial population is evaluated,
+	then there is one point per generation. Wall time includes the cost of
+	ThreadsDE::getBestCandidate used to sample the curve.
+*/
+struct RunResult {
+	uint64_t seed;
+	std::vector<ConvergencePoint> curve;
+};
+
+/// \cond DEV
+inline uint64_t splitMix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+/// \endcond
+
+//! Seed of the `run`-th repetition of a benchmark started with `base_seed`.
+inline uint64_t runSeed(const uint64_t base_seed, const uint32_t run) {
+	return splitMix64(base_seed ^ splitMix64(run));
+}
+
+//! Owns the solver described by a Configuration.
+/*!
+	BaseDE destructor is protected, so the concrete solver owns the memory and
+	`de` gives access to the common interface.
+*/
+template <int DIM>
+struct Solver {
+	std::unique_ptr<ThreadsDE<double,DIM,double>> threads_de;
+	std::unique_ptr<SequentialDE<double,DIM,double>> sequential_de;
+	BaseDE<double,DIM,double>* de;
+
+	Solver(const Configuration& config,
+		std::function<double()>&& population_generator,
+		std::function<double(const std::array<double,DIM>&)>&& calc_error,
+		std::function<bool(const double&,const double&)>&& error_evaluation,
+		const uint64_t seed) {
+		using namespace std;
+		if (config.threaded) {
+			threads_de.reset(new ThreadsDE<double,DIM,double>(config.n_process,
+				config.migration_phi, config.pop_size, config.CR, config.F,
+				move(population_generator), move(calc_error),
+				move(error_evaluation), seed));
+			de = threads_de.get();
+		} else {
+			sequential_de.reset(new SequentialDE<double,DIM,double>(config.pop_size,
+				config.CR, config.F,
+				move(population_generator), move(calc_error),
+				move(error_evaluation), seed));
+			de = sequential_de.get();
+		}
+	}
+};
+
+//! Population generator, uniform in [-limit, limit].
+/*!
+	Not thread safe: each solver needs its own. ThreadsDE calls it from the
+	calling thread, one island after the other.
+*/
+inline std::function<double()> makePopulationGenerator(const double limit,
+	const uint64_t seed) {
+	using namespace std;
+	auto engine = make_shared<mt19937_64>(seed);
+	uniform_real_distribution<double> ud(-limit, limit);
+	return [engine, ud]() mutable -> double {
+		return ud(*engine);
+	};
+}
+
+//! Runs one configuration on one problem for `generations` generations.
+template <int DIM>
+RunResult runOnce(const Configuration& config, const Problem<DIM>& problem,
+	const uint32_t generations, const uint64_t seed) {
+	using namespace std;
+	using Clock = chrono::steady_clock;
+
+	// ThreadsDE calls calc_error from several threads at once
+	auto evaluations = make_shared<atomic<uint64_t>>(0);
+	auto calc_error = [evaluations, &problem](const array<double,DIM>& arr) -> double {
+		evaluations->fetch_add(1, memory_order_relaxed);
+		return problem.calc_error(arr);
+	};
+
+	auto rand_domain = makePopulationGenerator(problem.domain_limit, splitMix64(seed));
+
+	auto error_evaluation = [](const double& a, const double& b) {
+		return a < b;
+	};
+
+	RunResult result;
+	result.seed = seed;
+	result.curve.reserve(generations + 1);
+
+	const auto start = Clock::now();
+	auto sample = [&]() {
+		return ConvergencePoint{evaluations->load(),
+			chrono::duration<double>(Clock::now() - start).count(), 0.0};
+	};
+
+	Solver<DIM> solver(config, move(rand_domain), move(calc_error),
+		move(error_evaluation), seed);
+	BaseDE<double,DIM,double>* de = solver.de;
+
+	const double initial_error = get<0>(de->getBestCandidate());
+	result.curve.push_back(sample());
+	result.curve.back().best_error = initial_error;
+
+	for (uint32_t g = 0; g < generations; ++g) {
+		de->solveOneGeneration();
+		const double e = get<0>(de->getBestCandidate());
+		result.curve.push_back(sample());
+		// The best candidate may migrate away, the curve keeps the best so far
+		result.curve.back().best_error = min(e, result.curve[result.curve.size() - 2].best_error);
+	}
+	return result;
+}
+
+//! Startup latency of a short job.
+/*!
+	Returns {seconds to construct the solver, seconds from the start of the
+	construction until the first generation is solved}.
+*/
+template <int DIM>
+std::tuple<double,double> startupLatency(const Configuration& config,
+	const Problem<DIM>& problem, const uint64_t seed) {
+	using namespace std;
+	using Clock = chrono::steady_clock;
+	auto rand_domain = makePopulationGenerator(problem.domain_limit, seed);
+	auto calc_error = problem.calc_error;
+
+	const auto start = Clock::now();
+	Solver<DIM> solver(config, move(rand_domain), move(calc_error),
+		[](const double& a, const double& b) { return a < b; }, seed);
+	const auto constructed = Clock::now();
+	solver.de->solveOneGeneration();
+	const auto solved = Clock::now();
+
+	return tuple<double,double>{
+		chrono::duration<double>(constructed - start).count(),
+		chrono::duration<double>(solved - start).count()};
+}
+
+//! Runs `runs` independent seeded repetitions, `parallel_runs` of them at a time.
+/*!
+	Repetition `r` uses the seed runSeed(base_seed, r), so two configurations
+	benchmarked with the same `base_seed` can be compared as paired samples.
+	Results are returned in repetition order.
+*/
+template <int DIM>
+std::vector<RunResult> runRepetitions(const Configuration& config,
+	const Problem<DIM>& problem, const uint32_t generations,
+	const uint32_t runs, const uint64_t base_seed,
+	const uint32_t parallel_runs) {
+	using namespace std;
+	vector<RunResult> results(runs);
+	atomic<uint32_t> next_run{0};
+
+	auto worker = [&]() {
+		for (uint32_t r = next_run++; r < runs; r = next_run++) {
+			results[r] = runOnce(config, problem, generations, runSeed(base_seed, r));
+		}
+	};
+
+	vector<thread> threads;
+	const uint32_t n = max(1u, min(parallel_runs, runs));
+	for (uint32_t t = 1; t < n; ++t) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads) {
+		t.join();
+	}
+	return results;
+}
+
+//! Effort spent by a run until its best error reached `target`.
+/*!
+	Returns {evaluations, seconds}. Both are infinite when the target was never hit.
+*/
+inline std::tuple<double,double> hittingTime(const RunResult& run, const double target) {
+	for (auto& p : run.curve) {
+		if (p.best_error <= target) {
+			return std::tuple<double,double>{static_cast<double>(p.evaluations), p.seconds};
+		}
+	}
+	const double inf = std::numeric_limits<double>::infinity();
+	return std::tuple<double,double>{inf, inf};
+}
+
+//! Empirical cumulative distribution of the runtime, in evaluations.
+/*!
+	For every budget returns the fraction of (run,target) pairs whose target
+	was hit with at most that many evaluations.
+*/
+inline std::vector<double> ecdf(const std::vector<RunResult>& runs,
+	const std::vector<double>& targets, const std::vector<double>& budgets) {
+	std::vector<double> hits;
+	for (auto& r : runs) {
+		for (auto t : targets) {
+			hits.push_back(std::get<0>(hittingTime(r, t)));
+		}
+	}
+	std::sort(hits.begin(), hits.end());
+
+	std::vector<double> fractions;
+	for (auto b : budgets) {
+		const auto n = std::upper_bound(hits.begin(), hits.end(), b) - hits.begin();
+		fractions.push_back(hits.empty() ? 0.0 : n / static_cast<double>(hits.size()));
+	}
+	return fractions;
+}
+
+//! Expected running time, in evaluations, to reach `target`.
+/*!
+	Sum of the evaluations of every run (until the hit, or the whole run when
+	it failed) divided by the number of successful runs. Infinite when no run
+	reached the target.
+*/
+inline double expectedRunningTime(const std::vector<RunResult>& runs,
+	const double target) {
+	double total = 0;
+	uint32_t successes = 0;
+	for (auto& r : runs) {
+		const double e = std::get<0>(hittingTime(r, target));
+		if (e < std::numeric_limits<double>::infinity()) {
+			total += e;
+			++successes;
+		} else if (!r.curve.empty()) {
+			total += r.curve.back().evaluations;
+		}
+	}
+	return successes ? total / successes : std::numeric_limits<double>::infinity();
+}
+
+} // namespace bench
+} // namespace pdebc
+
+#endif /* ANYTIMEBENCHMARK_HPP_ */
@@ -0,0 +1,165 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef BENCHMARKRESULTS_HPP_
+#define BENCHMARKRESULTS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Statistics.hpp"
+
+namespace pdebc {
+namespace bench {
+
+//! Repeated measurements of one metric of one benchmark.
+struct Measurement {
+	std::string benchmark;
+	std::string metric; ///< e.g. "throughput" (evaluations/s) or "time_to_target" (s).
+	bool higher_is_better;
+	std::vector<double> samples;
+};
+
+//! Writes measurements in the plain text format read by readResults().
+/*!
+	One measurement per line:
+	`benchmark metric higher|lower sample0 sample1 ...`
+	Lines starting with '#' are comments.
+*/
+inline bool writeResults(const std::string& path,
+	const std::vector<Measurement>& results, const std::string& comment) {
+	FILE* f = fopen(path.c_str(), "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "# pdebc benchmark results\n# %s\n", comment.c_str());
+	for (auto& m : results) {
+		fprintf(f, "%s %s %s", m.benchmark.c_str(), m.metric.c_str(),
+			m.higher_is_better ? "higher" : "lower");
+		for (auto s : m.samples) {
+			fprintf(f, " %.9g", s);
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return true;
+}
+
+inline bool readResults(const std::string& path, std::vector<Measurement>& results) {
+	using namespace std;
+	ifstream in(path);
+	if (!in) {
+		return false;
+	}
+	results.clear();
+	for (string line; getline(in, line);) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		istringstream ss(line);
+		Measurement m;
+		string better;
+		if (!(ss >> m.benchmark >> m.metric >> better)) {
+			return false;
+		}
+		m.higher_is_better = better == "higher";
+		for (double v; ss >> v;) {
+			m.samples.push_back(v);
+		}
+		results.push_back(m);
+	}
+	return true;
+}
+
+//! Noise of a sample: the scaled MAD, a robust standard deviation.
+inline double absoluteNoise(const std::vector<double>& samples) {
+	const double m = median(samples);
+	std::vector<double> dev;
+	for (auto s : samples) {
+		dev.push_back(std::fabs(s - m));
+	}
+	return 1.4826 * median(dev);
+}
+
+//! Relative noise of a sample: the scaled MAD (a robust standard deviation) over the median.
+inline double relativeNoise(const std::vector<double>& samples) {
+	const double m = median(samples);
+	return m != 0 ? absoluteNoise(samples) / std::fabs(m) : 0.0;
+}
+
+enum class Verdict {
+	UNCHANGED,
+	IMPROVEMENT,
+	REGRESSION
+};
+
+//! Outcome of comparing a measurement against its baseline.
+struct Comparison {
+	double baseline_median;
+	double current_median;
+	bool relative; ///< False when the baseline median is 0: the delta and threshold are then absolute.
+	double relative_delta; ///< (current - baseline) / baseline, or current - baseline; sign follows the metric, not "better".
+	double threshold; ///< Change that must be exceeded to report a difference.
+	double p_value; ///< Mann-Whitney U two-sided p-value.
+	Verdict verdict;
+};
+
+//! Compares repeated measurements with a noise-aware threshold.
+/*!
+	The threshold is the largest of `min_threshold` and `noise_factor` times the
+	relative noise (scaled MAD) of the noisier of the two samples. A change is
+	only reported when it also is significant under the Mann-Whitney U test
+	with level `alpha`, so a few outliers cannot flag a regression alone.
+
+	A baseline median of 0 (a counter or an allocation count) has no relative
+	change: the delta is then current - baseline, against `noise_factor` times
+	the absolute noise.
+*/
+inline Comparison compare(const Measurement& baseline, const Measurement& current,
+	const double min_threshold, const double noise_factor, const double alpha) {
+	Comparison c;
+	c.baseline_median = median(baseline.samples);
+	c.current_median = median(current.samples);
+	c.relative = c.baseline_median != 0;
+	if (c.relative) {
+		c.relative_delta = (c.current_median - c.baseline_median) / c.baseline_median;
+		c.threshold = std::max(min_threshold, noise_factor
+			* std::max(relativeNoise(baseline.samples), relativeNoise(current.samples)));
+	} else {
+		c.relative_delta = c.current_median;
+		c.threshold = noise_factor
+			* std::max(absoluteNoise(baseline.samples), absoluteNoise(current.samples));
+	}
+	c.p_value = mannWhitneyU(baseline.samples, current.samples).p_value;
+
+	const double gain = baseline.higher_is_better ? c.relative_delta : -c.relative_delta;
+	c.verdict = Verdict::UNCHANGED;
+	if (std::fabs(c.relative_delta) > c.threshold && c.p_value < alpha) {
+		c.verdict = gain > 0 ? Verdict::IMPROVEMENT : Verdict::REGRESSION;
+	}
+	return c;
+}
+
+} // namespace bench
+} // namespace pdebc
+
+#endif /* BENCHMARKRESULTS_HPP_ */
@@ -0,0 +1,132 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef PERFCOUNTERS_HPP_
+#define PERFCOUNTERS_HPP_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace pdebc {
+namespace bench {
+
+//! Hardware counters of the calling thread, read through perf_event_open.
+/*!
+	Counters are optional: on other systems, or when the kernel refuses them
+	(see /proc/sys/kernel/perf_event_paranoid), available() returns false and
+	every read returns zeros.
+*/
+struct PerfCounters {
+	enum Event {
+		CYCLES,
+		INSTRUCTIONS,
+		CACHE_MISSES,
+		BRANCH_MISSES,
+		N_EVENTS
+	};
+	using Values = std::array<uint64_t, N_EVENTS>;
+
+	PerfCounters() {
+		fds_.fill(-1);
+#ifdef __linux__
+		const uint64_t configs[N_EVENTS] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+		for (int e = 0; e < N_EVENTS; ++e) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[e];
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds_[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#endif
+	}
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (auto fd : fds_) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available() const {
+		for (auto fd : fds_) {
+			if (fd < 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void start() {
+#ifdef __linux__
+		for (auto fd : fds_) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	//! Stops counting and returns the counts since start().
+	Values stop() {
+		Values v;
+		v.fill(0);
+#ifdef __linux__
+		for (int e = 0; e < N_EVENTS; ++e) {
+			if (fds_[e] >= 0) {
+				ioctl(fds_[e], PERF_EVENT_IOC_DISABLE, 0);
+				uint64_t count = 0;
+				if (read(fds_[e], &count, sizeof(count)) == sizeof(count)) {
+					v[e] = count;
+				}
+			}
+		}
+#endif
+		return v;
+	}
+
+private:
+	std::array<int, N_EVENTS> fds_;
+};
+
+} // namespace bench
+} // namespace pdebc
+
+#endif /* PERFCOUNTERS_HPP_ */
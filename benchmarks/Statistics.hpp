@@ -0,0 +1,179 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef STATISTICS_HPP_
+#define STATISTICS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace pdebc {
+namespace bench {
+
+//! Result of a rank based hypothesis test.
+struct RankTest {
+	double statistic; ///< U for Mann-Whitney, W+ for Wilcoxon.
+	double z; ///< Normal approximation of the statistic (tie and continuity corrected).
+	double p_value; ///< Two-sided p-value.
+	double effect_size; ///< Vargha-Delaney A12 (Mann-Whitney) or matched-pairs rank-biserial (Wilcoxon).
+};
+
+/// \cond DEV
+inline double normalTwoSidedP(const double z) {
+	return std::erfc(std::fabs(z) / std::sqrt(2.0));
+}
+
+// Assigns average ranks (1-based) to 'values'. Returns the tie correction
+// term sum(t^3 - t) over every group of t tied values.
+inline double averageRanks(const std::vector<double>& values,
+	std::vector<double>& ranks) {
+	using namespace std;
+	const size_t n = values.size();
+	vector<size_t> order(n);
+	iota(order.begin(), order.end(), 0);
+	sort(order.begin(), order.end(), [&values](size_t a, size_t b) {
+		return values[a] < values[b];
+	});
+
+	ranks.assign(n, 0.0);
+	double ties = 0.0;
+	size_t i = 0;
+	while (i < n) {
+		size_t j = i + 1;
+		while (j < n && values[order[j]] == values[order[i]]) {
+			++j;
+		}
+		const double r = 0.5 * (i + 1 + j);
+		for (size_t k = i; k < j; ++k) {
+			ranks[order[k]] = r;
+		}
+		const double t = static_cast<double>(j - i);
+		ties += t * t * t - t;
+		i = j;
+	}
+	return ties;
+}
+/// \endcond
+
+//! Mann-Whitney U test for two independent samples.
+/*!
+	Smaller values are considered better (errors, running times), so the
+	effect size is A12 = P(a < b) + 0.5 P(a == b): 0.5 means no difference,
+	values above 0.5 mean 'a' tends to be better than 'b'.
+	Infinite values (e.g. a target never hit) are valid and rank last.
+*/
+inline RankTest mannWhitneyU(const std::vector<double>& a,
+	const std::vector<double>& b) {
+	using namespace std;
+	const double n1 = a.size();
+	const double n2 = b.size();
+	RankTest r{0.0, 0.0, 1.0, 0.5};
+	if (a.empty() || b.empty()) {
+		return r;
+	}
+
+	vector<double> all(a);
+	all.insert(all.end(), b.begin(), b.end());
+	vector<double> ranks;
+	const double ties = averageRanks(all, ranks);
+
+	const double r1 = accumulate(ranks.begin(), ranks.begin() + a.size(), 0.0);
+	const double u1 = r1 - n1 * (n1 + 1) / 2; // number of (a > b) pairs
+	const double n = n1 + n2;
+	const double mean = n1 * n2 / 2;
+	const double var = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+
+	r.statistic = u1;
+	if (var > 0) {
+		const double d = u1 - mean;
+		const double cc = d > 0 ? -0.5 : (d < 0 ? 0.5 : 0.0);
+		r.z = (d + cc) / sqrt(var);
+		r.p_value = normalTwoSidedP(r.z);
+	}
+	r.effect_size = 1.0 - u1 / (n1 * n2);
+	return r;
+}
+
+//! Wilcoxon signed-rank test for paired samples (e.g. two configurations run with the same seeds).
+/*!
+	Zero differences are dropped (Wilcoxon's method). The effect size is the
+	matched-pairs rank-biserial correlation in [-1,1]; positive values mean
+	'a' tends to be smaller (better) than 'b'.
+*/
+inline RankTest wilcoxonSignedRank(const std::vector<double>& a,
+	const std::vector<double>& b) {
+	using namespace std;
+	RankTest r{0.0, 0.0, 1.0, 0.0};
+	const size_t n = min(a.size(), b.size());
+
+	vector<double> abs_diff;
+	vector<int> sign;
+	for (size_t i = 0; i < n; ++i) {
+		// a == b also covers two infinite values (target never hit)
+		if (a[i] == b[i]) {
+			continue;
+		}
+		const double d = b[i] - a[i];
+		abs_diff.push_back(fabs(d));
+		sign.push_back(d > 0 ? 1 : -1);
+	}
+	if (abs_diff.empty()) {
+		return r;
+	}
+
+	vector<double> ranks;
+	const double ties = averageRanks(abs_diff, ranks);
+	double w_plus = 0;
+	double w_minus = 0;
+	for (size_t i = 0; i < ranks.size(); ++i) {
+		(sign[i] > 0 ? w_plus : w_minus) += ranks[i];
+	}
+
+	const double m = abs_diff.size();
+	const double mean = m * (m + 1) / 4;
+	const double var = m * (m + 1) * (2 * m + 1) / 24 - ties / 48;
+
+	r.statistic = w_plus;
+	if (var > 0) {
+		const double d = w_plus - mean;
+		const double cc = d > 0 ? -0.5 : (d < 0 ? 0.5 : 0.0);
+		r.z = (d + cc) / sqrt(var);
+		r.p_value = normalTwoSidedP(r.z);
+	}
+	r.effect_size = (w_plus - w_minus) / (w_plus + w_minus);
+	return r;
+}
+
+//! Median of a sample (infinite values allowed).
+inline double median(std::vector<double> v) {
+	if (v.empty()) {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+	std::sort(v.begin(), v.end());
+	const size_t h = v.size() / 2;
+	return v.size() % 2 ? v[h] : 0.5 * (v[h - 1] + v[h]);
+}
+
+} // namespace bench
+} // namespace pdebc
+
+#endif /* STATISTICS_HPP_ */
@@ -0,0 +1,199 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Allocation Check
+
+-> Counts heap allocations per phase (construction, first generation,
+	steady state...) of SequentialDE, ThreadsDE and the bezier fitting
+	driver loop, through the interposing allocator of AllocationCounter.cpp.
+-> The steady-state phases (solveOneGeneration, getBestCandidate and the
+	bezier control-point round) must not allocate: the program exits with 1
+	when they do.
+
+Usage:
+	allocation_check [--generations N]
+
+*/
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <random>
+#include <memory>
+#include <functional>
+
+#include "pdebc/SequentialDE.hpp"
+#include "pdebc/ThreadsDE.hpp"
+
+#include "BezierCurve.hpp"
+#include "AllocationCounter.hpp"
+
+using namespace pdebc::bench;
+
+struct Report {
+	AllocationPhases phases;
+	std::vector<bool> steady_state;
+	int failures{0};
+
+	void begin(const std::string& name, const bool steady) {
+		steady_state.push_back(steady);
+		phases.begin(name);
+	}
+
+	void end() {
+		const AllocationCount c = phases.end();
+		failures += steady_state.back() && c.allocations > 0;
+	}
+
+	void print() const {
+		auto& p = phases.phases();
+		printf("%-44s %12s %12s %14s\n", "phase", "allocations", "frees", "bytes");
+		for (size_t i = 0; i < p.size(); ++i) {
+			const bool bad = steady_state[i] && p[i].count.allocations > 0;
+			printf("%-44s %12llu %12llu %14llu%s\n", p[i].name.c_str(),
+				static_cast<unsigned long long>(p[i].count.allocations),
+				static_cast<unsigned long long>(p[i].count.deallocations),
+				static_cast<unsigned long long>(p[i].count.bytes),
+				bad ? "  <- steady state must not allocate" : (steady_state[i] ? "  ok" : ""));
+		}
+	}
+};
+
+double sphere(const std::array<double,2>& x) {
+	return x[0] * x[0] + x[1] * x[1];
+}
+
+template <class DE>
+void checkSolver(Report& r, const std::string& name, const uint32_t generations,
+	const std::function<DE*()>& make) {
+	using namespace std;
+	r.begin(name + ": construction", false);
+	unique_ptr<DE> de(make());
+	de->getBestCandidate();
+	r.end();
+
+	r.begin(name + ": first generation", false);
+	de->solveOneGeneration();
+	r.end();
+
+	r.begin(name + ": solveOneGeneration x" + to_string(generations), true);
+	de->solveNGenerations(generations);
+	r.end();
+
+	r.begin(name + ": getBestCandidate", true);
+	auto bc = de->getBestCandidate();
+	r.end();
+
+	r.begin(name + ": destruction", false);
+	de.reset();
+	r.end();
+	(void)bc;
+}
+
+void checkBezierDriver(Report& r, const uint32_t generations) {
+	using namespace std;
+	using MyThreadsDE = pdebc::ThreadsDE<double,2,double>;
+	r.begin("bezier driver: construction", false);
+	vector<tuple<double,Vec2d>> dp;
+	for (int i = 0; i < 1000; ++i) {
+		const double t = i / 999.0;
+		dp.push_back(tuple<double,Vec2d>{t, Vec2d{{40 * t, 10 * sin(6 * t)}}});
+	}
+	BezierCurve curve{dp, vector<Vec2d>(5)};
+	curve.control_points_[0] = get<1>(dp.front());
+	curve.control_points_[4] = get<1>(dp.back());
+
+	vector<shared_ptr<MyThreadsDE>> des;
+	for (int i = 0; i < 3; ++i) {
+		curve.updateVariableCPForOptimizationCache(i + 1);
+		mt19937 emt(i);
+		uniform_real_distribution<double> ud(-64, 64);
+		des.push_back(make_shared<MyThreadsDE>(4, 0.8, 64, 0.5, 0.8,
+			bind(ud, emt),
+			[&curve](const array<double,2>& arr) {
+				return curve.calcErrorWithOptimizationCache(arr);
+			},
+			[](const double& a, const double& b) { return a < b; },
+			i));
+	}
+	r.end();
+
+	// same loop as pypde::solveOneGeneration
+	auto round = [&]() {
+		for (int j = 0; j < 3; ++j) {
+			curve.updateVariableCPForOptimizationCache(j + 1);
+			des[j]->solveOneGeneration();
+			curve.control_points_[j + 1] = get<1>(des[j]->getBestCandidate());
+		}
+	};
+
+	r.begin("bezier driver: first round", false);
+	round();
+	r.end();
+
+	r.begin("bezier driver: control-point rounds x" + to_string(generations), true);
+	for (uint32_t g = 0; g < generations; ++g) {
+		round();
+	}
+	r.end();
+
+	r.begin("bezier driver: destruction", false);
+	des.clear();
+	r.end();
+}
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	uint32_t generations = 100;
+	if (argc == 3 && string(argv[1]) == "--generations") {
+		generations = stoul(argv[2]);
+	} else if (argc != 1) {
+		fprintf(stderr, "Usage: %s [--generations N]\n", argv[0]);
+		return 1;
+	}
+
+	Report r;
+	using MySequentialDE = pdebc::SequentialDE<double,2,double>;
+	using MyThreadsDE = pdebc::ThreadsDE<double,2,double>;
+
+	checkSolver<MySequentialDE>(r, "SequentialDE", generations, []() {
+		mt19937 emt(1);
+		uniform_real_distribution<double> ud(-128, 128);
+		return new MySequentialDE(128, 0.5, 0.8, bind(ud, emt), sphere,
+			[](const double& a, const double& b) { return a < b; }, 1);
+	});
+	checkSolver<MyThreadsDE>(r, "ThreadsDE", generations, []() {
+		mt19937 emt(2);
+		uniform_real_distribution<double> ud(-128, 128);
+		return new MyThreadsDE(4, 0.8, 128, 0.5, 0.8, bind(ud, emt), sphere,
+			[](const double& a, const double& b) { return a < b; }, 2);
+	});
+	checkBezierDriver(r, generations);
+
+	r.print();
+	if (r.failures) {
+		printf("%d steady-state phase(s) allocated\n", r.failures);
+		return 1;
+	}
+	printf("Steady state is allocation free\n");
+	return 0;
+}
@@ -0,0 +1,357 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Anytime Performance Benchmark
+
+-> Runs N independent seeded repetitions of one or two solver configurations
+	and records their convergence curves (best error against evaluations and
+	wall time).
+-> Reports ECDF and ERT (expected running time) for a set of error targets.
+-> Compares two configurations with the Wilcoxon signed-rank test (paired by
+	seed), the Mann-Whitney U test and their effect sizes.
+
+Usage:
+	anytime_benchmark [--problem sphere|rastrigin|rosenbrock] [--dim 2|4|8]
+		[--runs N] [--generations G] [--seed S] [--parallel P]
+		[--a CONFIG] [--b CONFIG] [--csv FILE]
+
+	CONFIG is "threads:n_process:migration_phi:pop_size:CR:F" or
+	"sequential:pop_size:CR:F".
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
+
+#include "AnytimeBenchmark.hpp"
+#include "Statistics.hpp"
+
+using namespace pdebc::bench;
+
+struct Options {
+	std::string problem{"sphere"};
+	int dim{2};
+	uint32_t runs{31};
+	uint32_t generations{200};
+	uint64_t seed{42};
+	uint32_t parallel{std::max(1u, std::thread::hardware_concurrency() / 8)};
+	std::vector<std::string> configs;
+	std::string csv;
+};
+
+// stoull/stod/stoi that also reject trailing characters ("12x")
+uint64_t toUnsigned(const std::string& v) {
+	size_t end;
+	const uint64_t u = std::stoull(v, &end);
+	if (end != v.size()) {
+		throw std::invalid_argument(v);
+	}
+	return u;
+}
+
+double toDouble(const std::string& v) {
+	size_t end;
+	const double d = std::stod(v, &end);
+	if (end != v.size()) {
+		throw std::invalid_argument(v);
+	}
+	return d;
+}
+
+int toInt(const std::string& v) {
+	size_t end;
+	const int i = std::stoi(v, &end);
+	if (end != v.size()) {
+		throw std::invalid_argument(v);
+	}
+	return i;
+}
+
+bool parseConfiguration(const std::string& spec, Configuration& c) {
+	using namespace std;
+	vector<string> f;
+	stringstream ss(spec);
+	for (string s; getline(ss, s, ':');) {
+		f.push_back(s);
+	}
+	c.name = spec;
+	try {
+		if (f.size() == 6 && f[0] == "threads") {
+			c.threaded = true;
+			c.n_process = toUnsigned(f[1]);
+			c.migration_phi = toDouble(f[2]);
+			c.pop_size = toUnsigned(f[3]);
+			c.CR = toDouble(f[4]);
+			c.F = toDouble(f[5]);
+			return c.n_process > 0 && c.pop_size / c.n_process >= 4;
+		} else if (f.size() == 4 && f[0] == "sequential") {
+			c.threaded = false;
+			c.n_process = 1;
+			c.migration_phi = 0;
+			c.pop_size = toUnsigned(f[1]);
+			c.CR = toDouble(f[2]);
+			c.F = toDouble(f[3]);
+			return c.pop_size >= 4;
+		}
+	} catch (const logic_error&) {
+		// not a number, or out of range
+	}
+	return false;
+}
+
+template <int DIM>
+bool makeProblem(const std::string& name, Problem<DIM>& p) {
+	using namespace std;
+	p.name = name;
+	if (name == "sphere") {
+		p.domain_limit = 128;
+		p.calc_error = [](const array<double,DIM>& x) {
+			double e = 0;
+			for (int d = 0; d < DIM; ++d) {
+				e += x[d] * x[d];
+			}
+			return e;
+		};
+	} else if (name == "rastrigin") {
+		p.domain_limit = 5.12;
+		p.calc_error = [](const array<double,DIM>& x) {
+			double e = 10.0 * DIM;
+			for (int d = 0; d < DIM; ++d) {
+				e += x[d] * x[d] - 10.0 * cos(2 * M_PI * x[d]);
+			}
+			return e;
+		};
+	} else if (name == "rosenbrock") {
+		p.domain_limit = 5;
+		p.calc_error = [](const array<double,DIM>& x) {
+			double e = 0;
+			for (int d = 0; d + 1 < DIM; ++d) {
+				const double a = x[d + 1] - x[d] * x[d];
+				const double b = 1 - x[d];
+				e += 100 * a * a + b * b;
+			}
+			return e;
+		};
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void writeCurves(FILE* f, const Configuration& c, const std::vector<RunResult>& runs) {
+	for (size_t r = 0; r < runs.size(); ++r) {
+		for (size_t g = 0; g < runs[r].curve.size(); ++g) {
+			auto& p = runs[r].curve[g];
+			fprintf(f, "%s,%zu,%llu,%zu,%llu,%.9g,%.17g\n", c.name.c_str(), r,
+				static_cast<unsigned long long>(runs[r].seed), g,
+				static_cast<unsigned long long>(p.evaluations), p.seconds, p.best_error);
+		}
+	}
+}
+
+void printComparison(const char* what, const std::vector<double>& a,
+	const std::vector<double>& b) {
+	const RankTest w = wilcoxonSignedRank(a, b);
+	const RankTest u = mannWhitneyU(a, b);
+	printf("  %-24s median A %-11.4g median B %-11.4g | Wilcoxon p=%-9.3g r=%+.3f | Mann-Whitney p=%-9.3g A12=%.3f\n",
+		what, median(a), median(b), w.p_value, w.effect_size, u.p_value, u.effect_size);
+}
+
+template <int DIM>
+int benchmark(const Options& o) {
+	using namespace std;
+	Problem<DIM> problem;
+	if (!makeProblem<DIM>(o.problem, problem)) {
+		fprintf(stderr, "Unknown problem '%s'\n", o.problem.c_str());
+		return 1;
+	}
+
+	vector<Configuration> configs;
+	for (auto& spec : o.configs) {
+		Configuration c;
+		if (!parseConfiguration(spec, c)) {
+			fprintf(stderr, "Invalid configuration '%s'\n", spec.c_str());
+			return 1;
+		}
+		configs.push_back(c);
+	}
+
+	vector<double> targets;
+	for (int e = 2; e >= -8; --e) {
+		targets.push_back(pow(10.0, e));
+	}
+
+	FILE* csv = nullptr;
+	if (!o.csv.empty()) {
+		csv = fopen(o.csv.c_str(), "w");
+		if (!csv) {
+			fprintf(stderr, "Could not open '%s'\n", o.csv.c_str());
+			return 1;
+		}
+		fprintf(csv, "config,run,seed,generation,evaluations,seconds,best_error\n");
+	}
+
+	printf("Problem %s, %dD, %u runs x %u generations, seed %llu\n",
+		problem.name.c_str(), DIM, o.runs, o.generations,
+		static_cast<unsigned long long>(o.seed));
+
+	vector<vector<RunResult>> results;
+	for (auto& c : configs) {
+		results.push_back(runRepetitions(c, problem, o.generations, o.runs,
+			o.seed, o.parallel));
+		auto& runs = results.back();
+		if (csv) {
+			writeCurves(csv, c, runs);
+		}
+
+		printf("%s\n", string(40,'*').c_str());
+		printf("Configuration %s\n", c.name.c_str());
+
+		const double max_evals = runs[0].curve.back().evaluations;
+		vector<double> budgets;
+		for (int i = 0; i <= 8; ++i) {
+			budgets.push_back(c.pop_size * pow(max_evals / c.pop_size, i / 8.0));
+		}
+		const auto fractions = ecdf(runs, targets, budgets);
+		printf("  ECDF (evaluations: fraction of run/target pairs solved)\n");
+		for (size_t i = 0; i < budgets.size(); ++i) {
+			printf("    %12.0f: %.3f\n", budgets[i], fractions[i]);
+		}
+
+		printf("  %-10s %-14s %-10s %-14s\n", "target", "ERT(evals)", "success", "median secs");
+		for (auto t : targets) {
+			vector<double> secs;
+			uint32_t successes = 0;
+			for (auto& r : runs) {
+				secs.push_back(get<1>(hittingTime(r, t)));
+				successes += secs.back() < numeric_limits<double>::infinity();
+			}
+			printf("  %-10.0e %-14.6g %3u/%-6u %-14.6g\n", t,
+				expectedRunningTime(runs, t), successes, o.runs, median(secs));
+		}
+	}
+
+	if (csv) {
+		fclose(csv);
+	}
+
+	if (results.size() == 2) {
+		// Same base seed, so run i of A and run i of B are paired
+		printf("%s\n", string(40,'*').c_str());
+		printf("A = %s\nB = %s\n", configs[0].name.c_str(), configs[1].name.c_str());
+		printf("  (effect sizes > 0.5 for A12 and > 0 for r mean A is better)\n");
+
+		vector<double> a, b;
+		for (size_t r = 0; r < o.runs; ++r) {
+			a.push_back(results[0][r].curve.back().best_error);
+			b.push_back(results[1][r].curve.back().best_error);
+		}
+		printComparison("final error", a, b);
+
+		for (auto t : {1e-2, 1e-6}) {
+			vector<double> ea, eb, sa, sb;
+			for (size_t r = 0; r < o.runs; ++r) {
+				ea.push_back(get<0>(hittingTime(results[0][r], t)));
+				eb.push_back(get<0>(hittingTime(results[1][r], t)));
+				sa.push_back(get<1>(hittingTime(results[0][r], t)));
+				sb.push_back(get<1>(hittingTime(results[1][r], t)));
+			}
+			char what[64];
+			snprintf(what, sizeof(what), "evals to %.0e", t);
+			printComparison(what, ea, eb);
+			snprintf(what, sizeof(what), "seconds to %.0e", t);
+			printComparison(what, sa, sb);
+		}
+	}
+	return 0;
+}
+
+void printUsage(const char* name) {
+	fprintf(stderr, "Usage: %s [--problem sphere|rastrigin|rosenbrock] [--dim 2|4|8]\n"
+		"\t[--runs N] [--generations G] [--seed S] [--parallel P]\n"
+		"\t[--a CONFIG] [--b CONFIG] [--csv FILE]\n"
+		"CONFIG is \"threads:n_process:migration_phi:pop_size:CR:F\" or\n"
+		"\"sequential:pop_size:CR:F\".\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	Options o;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const string k = argv[i];
+		const string v = argv[i + 1];
+		try {
+			if (k == "--problem") {
+				o.problem = v;
+			} else if (k == "--dim") {
+				o.dim = toInt(v);
+			} else if (k == "--runs") {
+				o.runs = toUnsigned(v);
+			} else if (k == "--generations") {
+				o.generations = toUnsigned(v);
+			} else if (k == "--seed") {
+				o.seed = toUnsigned(v);
+			} else if (k == "--parallel") {
+				o.parallel = toUnsigned(v);
+			} else if (k == "--a" || k == "--b") {
+				Configuration c;
+				if (!parseConfiguration(v, c)) {
+					fprintf(stderr, "Invalid configuration '%s'\n", v.c_str());
+					printUsage(argv[0]);
+					return 1;
+				}
+				o.configs.push_back(v);
+			} else if (k == "--csv") {
+				o.csv = v;
+			} else {
+				fprintf(stderr, "Unknown option '%s'\n", k.c_str());
+				printUsage(argv[0]);
+				return 1;
+			}
+		} catch (const logic_error&) {
+			// not a number, or out of range
+			fprintf(stderr, "Invalid value '%s' for %s\n", v.c_str(), k.c_str());
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (o.configs.empty()) {
+		o.configs = {"threads:8:0.8:128:0.5:0.8", "sequential:128:0.5:0.8"};
+	}
+	if (o.runs == 0 || o.configs.size() > 2) {
+		fprintf(stderr, "Need at least one run and at most two configurations\n");
+		return 1;
+	}
+
+	switch (o.dim) {
+	case 2: return benchmark<2>(o);
+	case 4: return benchmark<4>(o);
+	case 8: return benchmark<8>(o);
+	}
+	fprintf(stderr, "Unsupported dimension %d\n", o.dim);
+	return 1;
+}
@@ -0,0 +1,109 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Benchmark Compare
+
+-> Compares a results file written by regression_benchmark against a
+	stored baseline (see the "baselines" directory).
+-> A change is flagged when the medians differ by more than a noise-aware
+	threshold (derived from the spread of the repeated samples) and the
+	Mann-Whitney U test agrees.
+-> Exits with 1 when any benchmark regressed, so it can gate a release.
+
+Usage:
+	benchmark_compare BASELINE CURRENT [--min-threshold 0.05]
+		[--noise-factor 3] [--alpha 0.05]
+
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "BenchmarkResults.hpp"
+
+using namespace pdebc::bench;
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s BASELINE CURRENT [--min-threshold T]"
+			" [--noise-factor K] [--alpha A]\n", argv[0]);
+		return 2;
+	}
+	double min_threshold = 0.05;
+	double noise_factor = 3;
+	double alpha = 0.05;
+	for (int i = 3; i + 1 < argc; i += 2) {
+		const string k = argv[i];
+		if (k == "--min-threshold") {
+			min_threshold = stod(argv[i + 1]);
+		} else if (k == "--noise-factor") {
+			noise_factor = stod(argv[i + 1]);
+		} else if (k == "--alpha") {
+			alpha = stod(argv[i + 1]);
+		} else {
+			fprintf(stderr, "Unknown option '%s'\n", k.c_str());
+			return 2;
+		}
+	}
+
+	vector<Measurement> baseline, current;
+	if (!readResults(argv[1], baseline) || !readResults(argv[2], current)) {
+		fprintf(stderr, "Could not read the results files\n");
+		return 2;
+	}
+
+	int regressions = 0;
+	printf("%-24s %-16s %12s %12s %9s %9s %9s  %s\n", "benchmark", "metric",
+		"baseline", "current", "delta", "threshold", "p-value", "verdict");
+	for (auto& c : current) {
+		const Measurement* b = nullptr;
+		for (auto& m : baseline) {
+			if (m.benchmark == c.benchmark && m.metric == c.metric) {
+				b = &m;
+			}
+		}
+		if (!b) {
+			printf("%-24s %-16s %12s %12.4g %9s %9s %9s  new\n", c.benchmark.c_str(),
+				c.metric.c_str(), "-", median(c.samples), "-", "-", "-");
+			continue;
+		}
+
+		const Comparison r = compare(*b, c, min_threshold, noise_factor, alpha);
+		const char* verdict = r.verdict == Verdict::REGRESSION ? "REGRESSION"
+			: (r.verdict == Verdict::IMPROVEMENT ? "improvement" : "ok");
+		regressions += r.verdict == Verdict::REGRESSION;
+		if (r.relative) {
+			printf("%-24s %-16s %12.4g %12.4g %+8.1f%% %8.1f%% %9.3g  %s\n",
+				c.benchmark.c_str(), c.metric.c_str(), r.baseline_median,
+				r.current_median, 100 * r.relative_delta, 100 * r.threshold,
+				r.p_value, verdict);
+		} else {
+			// a zero baseline: absolute delta and threshold
+			printf("%-24s %-16s %12.4g %12.4g %+9.3g %9.3g %9.3g  %s\n",
+				c.benchmark.c_str(), c.metric.c_str(), r.baseline_median,
+				r.current_median, r.relative_delta, r.threshold,
+				r.p_value, verdict);
+		}
+	}
+
+	printf("%d regression(s)\n", regressions);
+	return regressions ? 1 : 0;
+}
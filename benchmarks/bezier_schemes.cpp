@@ -0,0 +1,281 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Bezier Fitting Schemes Benchmark
+
+-> Fits the same noisy data with the two DE schemes of the bezier sample:
+	"coordinate", one 2-D ThreadsDE per inner control point run one after
+	the other (as pypde does), "jacobi", the same DEs running at the same
+	time against copies of their caches with damped updates, and "joint",
+	a single kDynamicDim ThreadsDE over every inner control point.
+-> Reports the median fit error reached after a set of wall times, next to
+	the exact least-squares optimum for the same parameterization.
+	Sampling the error is not counted in the wall time.
+
+Usage:
+	bezier_schemes [--data-points N] [--control-points N] [--seconds S]
+		[--runs N] [--seed S] [--damping D]
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "AnytimeBenchmark.hpp"
+#include "Statistics.hpp"
+#include "BezierCurve.hpp"
+
+using namespace pdebc::bench;
+
+constexpr uint32_t kNProcess{4};
+constexpr uint32_t kPopSize{128};
+constexpr double kDomainLimit{64};
+
+// Noisy three-quarter circle, parameterized by chord length
+std::vector<std::tuple<double,Vec2d>> makeData(const uint32_t n_points,
+	const uint64_t seed) {
+	using namespace std;
+	mt19937_64 engine(seed);
+	normal_distribution<double> noise(0, 0.1);
+	vector<Vec2d> points;
+	for (uint32_t i = 0; i < n_points; ++i) {
+		const double a = 4.7 * i / (n_points - 1);
+		points.push_back(Vec2d{{10 * cos(a) + noise(engine),
+			10 * sin(a) + noise(engine)}});
+	}
+	vector<double> length(n_points, 0);
+	for (uint32_t i = 1; i < n_points; ++i) {
+		length[i] = length[i - 1] + hypot(points[i][0] - points[i - 1][0],
+			points[i][1] - points[i - 1][1]);
+	}
+	vector<tuple<double,Vec2d>> data;
+	for (uint32_t i = 0; i < n_points; ++i) {
+		data.push_back(tuple<double,Vec2d>{length[i] / length.back(), points[i]});
+	}
+	return data;
+}
+
+// Error against wall time, sampled once per generation (or round)
+using Trajectory = std::vector<std::tuple<double,double>>;
+
+Trajectory runCoordinate(BezierCurve& curve, const double seconds,
+	const uint64_t seed) {
+	using namespace std;
+	using Clock = chrono::steady_clock;
+	using CoordinateDE = pdebc::ThreadsDE<double,2,double>;
+	const int inner = curve.kNumberControlPoints_ - 2;
+	vector<unique_ptr<CoordinateDE>> des;
+	for (int i = 0; i < inner; ++i) {
+		des.emplace_back(new CoordinateDE(kNProcess, 1, kPopSize, 0.5, 0.8,
+			makePopulationGenerator(kDomainLimit, runSeed(seed, i)),
+			[&curve](const array<double,2>& cp) {
+				return curve.calcErrorWithOptimizationCache(cp);
+			},
+			[](const double& a, const double& b) {
+				return a < b;
+			},
+			runSeed(seed, inner + i)));
+	}
+
+	Trajectory trajectory;
+	double elapsed = 0;
+	while (elapsed < seconds) {
+		const auto start = Clock::now();
+		for (int j = 0; j < inner; ++j) {
+			curve.updateVariableCPForOptimizationCache(j + 1);
+			des[j]->solveOneGeneration();
+			curve.control_points_[j + 1] = get<1>(des[j]->getBestCandidate());
+		}
+		elapsed += chrono::duration<double>(Clock::now() - start).count();
+		trajectory.push_back(make_tuple(elapsed, curve.calcError()));
+	}
+	return trajectory;
+}
+
+Trajectory runJacobi(BezierCurve& curve, const double seconds,
+	const double damping, const uint64_t seed) {
+	using namespace std;
+	using Clock = chrono::steady_clock;
+	using CoordinateDE = pdebc::ThreadsDE<double,2,double>;
+	const int inner = curve.kNumberControlPoints_ - 2;
+	vector<VariableCPCache> caches(inner);
+	vector<unique_ptr<CoordinateDE>> des;
+	for (int i = 0; i < inner; ++i) {
+		curve.updateVariableCPForOptimizationCache(i + 1);
+		caches[i] = curve.getVariableCPCache();
+		des.emplace_back(new CoordinateDE(kNProcess, 1, kPopSize, 0.5, 0.8,
+			makePopulationGenerator(kDomainLimit, runSeed(seed, i)),
+			[&caches, i](const array<double,2>& cp) {
+				return caches[i].calcError(cp);
+			},
+			[](const double& a, const double& b) {
+				return a < b;
+			},
+			runSeed(seed, inner + i)));
+	}
+
+	Trajectory trajectory;
+	double elapsed = 0;
+	while (elapsed < seconds) {
+		const auto start = Clock::now();
+		for (int j = 0; j < inner; ++j) {
+			curve.updateVariableCPForOptimizationCache(j + 1);
+			caches[j] = curve.getVariableCPCache();
+		}
+		for (auto& de : des) {
+			de->startGeneration();
+		}
+		for (auto& de : des) {
+			de->finishGeneration();
+		}
+		for (int j = 0; j < inner; ++j) {
+			const auto best = get<1>(des[j]->getBestCandidate());
+			auto& cp = curve.control_points_[j + 1];
+			cp[0] += damping * (best[0] - cp[0]);
+			cp[1] += damping * (best[1] - cp[1]);
+		}
+		elapsed += chrono::duration<double>(Clock::now() - start).count();
+		trajectory.push_back(make_tuple(elapsed, curve.calcError()));
+	}
+	return trajectory;
+}
+
+Trajectory runJoint(BezierCurve& curve, const double seconds,
+	const uint64_t seed) {
+	using namespace std;
+	using Clock = chrono::steady_clock;
+	using JointDE = pdebc::ThreadsDE<double,pdebc::kDynamicDim,double>;
+	const int inner = curve.kNumberControlPoints_ - 2;
+	JointDE de(2 * inner, kNProcess, 1, kPopSize, 0.5, 0.8,
+		makePopulationGenerator(kDomainLimit, runSeed(seed, 0)),
+		[&curve](const vector<double>& v) {
+			return curve.calcErrorWithInnerControlPoints(v.data());
+		},
+		[](const double& a, const double& b) {
+			return a < b;
+		},
+		runSeed(seed, 1));
+
+	Trajectory trajectory;
+	double elapsed = 0;
+	while (elapsed < seconds) {
+		const auto start = Clock::now();
+		de.solveOneGeneration();
+		elapsed += chrono::duration<double>(Clock::now() - start).count();
+		trajectory.push_back(make_tuple(elapsed, get<0>(de.getBestCandidate())));
+	}
+	return trajectory;
+}
+
+// Last error sampled at or before `seconds`
+double errorAt(const Trajectory& trajectory, const double seconds) {
+	double error = std::numeric_limits<double>::infinity();
+	for (const auto& p : trajectory) {
+		if (std::get<0>(p) > seconds) {
+			break;
+		}
+		error = std::get<1>(p);
+	}
+	return error;
+}
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	uint32_t data_points = 2000;
+	uint32_t control_points = 6;
+	double seconds = 1;
+	uint32_t runs = 5;
+	uint64_t seed = 42;
+	double damping = 0.5;
+	for (int a = 1; a < argc; a += 2) {
+		const string arg = argv[a];
+		if (a + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", arg.c_str());
+			return 1;
+		}
+		if (arg == "--data-points") {
+			data_points = stoul(argv[a + 1]);
+		} else if (arg == "--control-points") {
+			control_points = stoul(argv[a + 1]);
+		} else if (arg == "--seconds") {
+			seconds = stod(argv[a + 1]);
+		} else if (arg == "--runs") {
+			runs = stoul(argv[a + 1]);
+		} else if (arg == "--seed") {
+			seed = stoull(argv[a + 1]);
+		} else if (arg == "--damping") {
+			damping = stod(argv[a + 1]);
+		} else {
+			fprintf(stderr, "Usage: %s [--data-points N] [--control-points N] "
+				"[--seconds S] [--runs N] [--seed S] [--damping D]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (control_points < 3 || data_points < control_points) {
+		fprintf(stderr, "Need at least 3 control points and as many data points\n");
+		return 1;
+	}
+
+	const auto data = makeData(data_points, seed);
+	vector<Vec2d> initial(control_points);
+	initial.front() = get<1>(data.front());
+	initial.back() = get<1>(data.back());
+
+	BezierCurve optimum{data, initial};
+	optimum.solveControlPointsWithLeastSquares();
+	printf("%u data points, %u control points, least-squares optimum error %g\n",
+		data_points, control_points, optimum.calcError());
+
+	vector<double> checkpoints;
+	for (double t = 1e-3; t < seconds; t *= sqrt(10.0)) {
+		checkpoints.push_back(t);
+	}
+	checkpoints.push_back(seconds);
+
+	vector<vector<double>> coordinate(checkpoints.size());
+	vector<vector<double>> jacobi(checkpoints.size());
+	vector<vector<double>> joint(checkpoints.size());
+	for (uint32_t r = 0; r < runs; ++r) {
+		BezierCurve coordinate_curve{data, initial};
+		const auto c = runCoordinate(coordinate_curve, seconds, runSeed(seed, 3 * r));
+		BezierCurve jacobi_curve{data, initial};
+		const auto p = runJacobi(jacobi_curve, seconds, damping, runSeed(seed, 3 * r + 1));
+		BezierCurve joint_curve{data, initial};
+		const auto j = runJoint(joint_curve, seconds, runSeed(seed, 3 * r + 2));
+		for (size_t k = 0; k < checkpoints.size(); ++k) {
+			coordinate[k].push_back(errorAt(c, checkpoints[k]));
+			jacobi[k].push_back(errorAt(p, checkpoints[k]));
+			joint[k].push_back(errorAt(j, checkpoints[k]));
+		}
+	}
+
+	printf("%12s %16s %16s %16s\n", "seconds", "coordinate", "jacobi", "joint");
+	for (size_t k = 0; k < checkpoints.size(); ++k) {
+		printf("%12.4f %16.6g %16.6g %16.6g\n", checkpoints[k],
+			median(coordinate[k]), median(jacobi[k]), median(joint[k]));
+	}
+	return 0;
+}
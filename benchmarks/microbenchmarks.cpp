@@ -0,0 +1,379 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Microbenchmarks
+
+-> Times the steps of a DE generation in isolation (pdebc::kernels), the
+	ThreadsDE coordinator/worker handshake, the ThreadsDE migration step
+	across island counts and the BezierCurve evaluation paths of the bezier
+	fitting sample, with the basis stored and recomputed.
+-> Kernels are parameterized over POP_DIM, population size and, for the
+	trial construction, population layout (AoS as used by the library or
+	SoA).
+-> Reports ns/op and, with --perf, hardware counters per op read through
+	perf_event_open (calling thread only).
+
+Usage:
+	microbenchmarks [--filter SUBSTRING] [--perf]
+
+*/
+
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <random>
+#include <functional>
+#include <algorithm>
+
+#include "pdebc/DEKernels.hpp"
+#include "pdebc/ThreadsDE.hpp"
+
+#include "BezierCurve.hpp"
+#include "PerfCounters.hpp"
+
+using namespace pdebc::bench;
+
+template <class T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__)
+	asm volatile("" : : "g"(&value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+struct Harness {
+	std::string filter;
+	PerfCounters* perf;
+
+	//! Calls `f` (which performs `ops` operations) until 5 samples of ~10ms are taken.
+	template <class F>
+	void run(const std::string& kernel, const std::string& params,
+		const uint64_t ops, F&& f) {
+		using namespace std;
+		using Clock = chrono::steady_clock;
+		if ((kernel + " " + params).find(filter) == string::npos) {
+			return;
+		}
+
+		uint64_t calls = 1;
+		for (;;) {
+			const auto s = Clock::now();
+			for (uint64_t c = 0; c < calls; ++c) {
+				f();
+			}
+			if (Clock::now() - s > chrono::milliseconds(10)) {
+				break;
+			}
+			calls *= 2;
+		}
+
+		vector<double> samples;
+		PerfCounters::Values total{};
+		for (int r = 0; r < 5; ++r) {
+			if (perf) {
+				perf->start();
+			}
+			const auto s = Clock::now();
+			for (uint64_t c = 0; c < calls; ++c) {
+				f();
+			}
+			const double ns = chrono::duration<double, nano>(Clock::now() - s).count();
+			if (perf) {
+				const auto v = perf->stop();
+				for (int e = 0; e < PerfCounters::N_EVENTS; ++e) {
+					total[e] += v[e];
+				}
+			}
+			samples.push_back(ns / (calls * ops));
+		}
+		sort(samples.begin(), samples.end());
+
+		printf("%-26s %-36s %11.2f ns/op", kernel.c_str(), params.c_str(), samples[2]);
+		if (perf) {
+			const double n = 5.0 * calls * ops;
+			printf(" %9.1f cyc %9.1f ins %6.2f IPC %7.3f cache-miss %7.3f br-miss",
+				total[PerfCounters::CYCLES] / n, total[PerfCounters::INSTRUCTIONS] / n,
+				total[PerfCounters::INSTRUCTIONS] / double(max<uint64_t>(1, total[PerfCounters::CYCLES])),
+				total[PerfCounters::CACHE_MISSES] / n, total[PerfCounters::BRANCH_MISSES] / n);
+		}
+		printf("\n");
+	}
+};
+
+std::string params(const int dim, const uint32_t pop_size, const char* extra = "") {
+	return "dim=" + std::to_string(dim) + " pop=" + std::to_string(pop_size) + extra;
+}
+
+template <int DIM>
+struct Population {
+	std::vector<std::array<double,DIM>> aos;
+	std::vector<double> soa; // soa[d * size + i]
+	std::vector<double> errors;
+	std::function<double()> random_cr;
+	std::function<uint32_t()> random_trials;
+	std::function<uint32_t()> random_j;
+
+	explicit Population(const uint32_t size) : aos(size), soa(size * DIM), errors(size) {
+		using namespace std;
+		mt19937 emt(1);
+		uniform_real_distribution<double> ud(-128, 128);
+		for (uint32_t i = 0; i < size; ++i) {
+			for (int d = 0; d < DIM; ++d) {
+				aos[i][d] = soa[d * size + i] = ud(emt);
+			}
+			errors[i] = sphere(aos[i]);
+		}
+		random_cr = bind(uniform_real_distribution<double>(0.0, 1.0), mt19937(2));
+		random_trials = bind(uniform_int_distribution<uint32_t>(0, size - 1), mt19937(3));
+		random_j = bind(uniform_int_distribution<uint32_t>(0, DIM - 1), mt19937(4));
+	}
+
+	static double sphere(const std::array<double,DIM>& x) {
+		double e = 0;
+		for (int d = 0; d < DIM; ++d) {
+			e += x[d] * x[d];
+		}
+		return e;
+	}
+};
+
+template <int DIM>
+void deKernels(Harness& h, const uint32_t pop_size) {
+	using namespace std;
+	using namespace pdebc::kernels;
+	Population<DIM> p(pop_size);
+	array<double,DIM> candidate{};
+	const double F = 0.8;
+	const double CR = 0.5;
+
+	h.run("sample_distinct_indices", params(DIM, pop_size), 1, [&]() {
+		uint32_t it0, it1, it2;
+		sampleDistinctIndices(p.random_trials, it0, it1, it2);
+		doNotOptimize(it0);
+		doNotOptimize(it1);
+		doNotOptimize(it2);
+	});
+
+	h.run("mutation", params(DIM, pop_size, " layout=aos"), pop_size, [&]() {
+		for (uint32_t i = 0; i < pop_size; ++i) {
+			uint32_t it0, it1, it2;
+			sampleDistinctIndices(p.random_trials, it0, it1, it2);
+			buildTrial<double,DIM>(p.aos[i], p.aos[it0], p.aos[it1], p.aos[it2],
+				F, CR, p.random_j(), p.random_cr, candidate);
+			doNotOptimize(candidate);
+		}
+	});
+
+	h.run("mutation", params(DIM, pop_size, " layout=soa"), pop_size, [&]() {
+		const double* s = p.soa.data();
+		for (uint32_t i = 0; i < pop_size; ++i) {
+			uint32_t it0, it1, it2;
+			sampleDistinctIndices(p.random_trials, it0, it1, it2);
+			int j = p.random_j();
+			candidate[j] = s[j * pop_size + it0]
+				+ F * (s[j * pop_size + it1] - s[j * pop_size + it2]);
+			j = (j + 1) % DIM;
+			for (int k = 1; k < DIM; ++k) {
+				const double* c = s + j * pop_size;
+				candidate[j] = p.random_cr() <= CR ? c[it0] + F * (c[it1] - c[it2]) : c[i];
+				j = (j + 1) % DIM;
+			}
+			doNotOptimize(candidate);
+		}
+	});
+
+	auto calc_error = [](const array<double,DIM>& x) { return Population<DIM>::sphere(x); };
+	auto error_evaluation = [](const double& a, const double& b) { return a < b; };
+	h.run("select", params(DIM, pop_size), pop_size, [&]() {
+		for (uint32_t i = 0; i < pop_size; ++i) {
+			// a slightly worse candidate keeps the population unchanged between runs
+			candidate = p.aos[i];
+			candidate[0] += 1e-3;
+			selectTrial(i, candidate, p.aos, p.errors, calc_error, error_evaluation);
+		}
+	});
+
+	h.run("best_candidate", params(DIM, pop_size), pop_size, [&]() {
+		doNotOptimize(bestCandidateIndex(p.errors, error_evaluation));
+	});
+}
+
+template <int DIM>
+void handshake(Harness& h, const uint32_t n_process) {
+	using namespace std;
+	using MyThreadsDE = pdebc::ThreadsDE<double,DIM,double>;
+	const uint32_t pop_size = 4 * n_process;
+	for (const double phi : {0.0, 1.0}) {
+		mt19937 emt(5);
+		uniform_real_distribution<double> ud(-128, 128);
+		MyThreadsDE de(n_process, phi, pop_size, 0.5, 0.8,
+			bind(ud, emt),
+			[](const array<double,DIM>& x) { return Population<DIM>::sphere(x); },
+			[](const double& a, const double& b) { return a < b; }, 6);
+		de.getBestCandidate();
+
+		const string p = params(DIM, pop_size, phi > 0 ? " migration=1" : " migration=0")
+			+ " threads=" + to_string(n_process);
+		h.run("handshake_generation", p, 1, [&]() {
+			de.solveOneGeneration();
+		});
+		if (phi == 0) {
+			h.run("handshake_best_candidate", p, 1, [&]() {
+				doNotOptimize(de.getBestCandidate());
+			});
+		}
+	}
+}
+
+// ThreadsDE's migration step by itself (migration_phi = 1, so every
+// island sends its best candidate), through ThreadsDE::migrateOnce()
+template <int DIM>
+void migration(Harness& h, const uint32_t n_islands, const uint32_t island_size) {
+	using namespace std;
+	using MyThreadsDE = pdebc::ThreadsDE<double,DIM,double>;
+	mt19937 emt(7);
+	uniform_real_distribution<double> ud(-128, 128);
+	MyThreadsDE de(n_islands, 1.0, n_islands * island_size, 0.5, 0.8,
+		bind(ud, emt),
+		[](const array<double,DIM>& x) { return Population<DIM>::sphere(x); },
+		[](const double& a, const double& b) { return a < b; }, 8);
+	de.getBestCandidate();
+
+	const string p = params(DIM, n_islands * island_size)
+		+ " islands=" + to_string(n_islands);
+	h.run("migration", p, 1, [&]() {
+		de.migrateOnce();
+	});
+}
+
+void bezier(Harness& h, const int n_data_points, const int n_control_points,
+	const BasisStorage storage) {
+	using namespace std;
+	vector<tuple<double,Vec2d>> dp;
+	for (int i = 0; i < n_data_points; ++i) {
+		const double t = i / double(n_data_points - 1);
+		dp.push_back(tuple<double,Vec2d>{t, Vec2d{{40 * t, 10 * sin(6 * t)}}});
+	}
+	vector<Vec2d> cp(n_control_points);
+	for (int i = 0; i < n_control_points; ++i) {
+		cp[i] = Vec2d{{40.0 * i / (n_control_points - 1), (i % 2) ? 5.0 : -5.0}};
+	}
+	BezierCurve curve{dp, cp, storage};
+	const string p = "dp=" + to_string(n_data_points) + " cp=" + to_string(n_control_points)
+		+ (storage == BasisStorage::Stored ? " basis=stored" : " basis=recompute");
+
+	h.run("bezier_getCurveInT", p, n_data_points, [&]() {
+		Vec2d out;
+		for (int i = 0; i < n_data_points; ++i) {
+			curve.getCurveInT(get<0>(dp[i]), out);
+			doNotOptimize(out);
+		}
+	});
+	vector<double> x(n_data_points);
+	vector<double> y(n_data_points);
+	double* const xy[2] = {x.data(), y.data()};
+	h.run("bezier_sampleUniformly", p, n_data_points, [&]() {
+		curve.sampleUniformly(0, 1, n_data_points, xy);
+		doNotOptimize(x.back());
+	});
+	h.run("bezier_calcError", p, 1, [&]() {
+		doNotOptimize(curve.calcError());
+	});
+	h.run("bezier_updateVariableCP", p, 1, [&]() {
+		curve.updateVariableCPForOptimizationCache(1);
+	});
+	const Vec2d candidate{{1.0, 2.0}};
+	h.run("bezier_calcErrorWithCache", p, 1, [&]() {
+		doNotOptimize(curve.calcErrorWithOptimizationCache(candidate));
+	});
+	vector<double> inner;
+	for (int i = 1; i + 1 < n_control_points; ++i) {
+		inner.push_back(cp[i][0]);
+		inner.push_back(cp[i][1]);
+	}
+	h.run("bezier_calcErrorInnerCP", p, 1, [&]() {
+		doNotOptimize(curve.calcErrorWithInnerControlPoints(inner.data()));
+	});
+	// the weights as DE dimensions, rescaling the cached basis
+	const vector<double> inner_weights(n_control_points - 2, 0.75);
+	h.run("bezier_calcErrorInnerCPWeights", p, 1, [&]() {
+		doNotOptimize(curve.calcErrorWithInnerControlPointsAndWeights(inner.data(),
+			inner_weights.data()));
+	});
+	// the projection does not use the basis
+	if (storage == BasisStorage::Stored) {
+		h.run("bezier_calcOrthogonalError", p, 1, [&]() {
+			doNotOptimize(curve.calcOrthogonalError());
+		});
+	}
+}
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	Harness h{"", nullptr};
+	bool use_perf = false;
+	for (int i = 1; i < argc; ++i) {
+		const string k = argv[i];
+		if (k == "--filter" && i + 1 < argc) {
+			h.filter = argv[++i];
+		} else if (k == "--perf") {
+			use_perf = true;
+		} else {
+			fprintf(stderr, "Unknown option '%s'\n", k.c_str());
+			return 1;
+		}
+	}
+
+	PerfCounters perf;
+	if (use_perf) {
+		if (perf.available()) {
+			h.perf = &perf;
+		} else {
+			fprintf(stderr, "Hardware counters are not available, reporting time only\n");
+		}
+	}
+
+	for (const uint32_t pop_size : {16u, 128u, 4096u}) {
+		deKernels<2>(h, pop_size);
+		deKernels<8>(h, pop_size);
+		deKernels<32>(h, pop_size);
+	}
+	for (const uint32_t n_process : {1u, 4u}) {
+		handshake<2>(h, n_process);
+	}
+	for (const uint32_t n_islands : {1u, 4u, 16u}) {
+		migration<2>(h, n_islands, 32);
+		migration<32>(h, n_islands, 32);
+	}
+	for (const int n_data_points : {100, 10000}) {
+		for (const int n_control_points : {4, 10}) {
+			for (const BasisStorage storage : {BasisStorage::Stored,
+				BasisStorage::Recompute}) {
+				bezier(h, n_data_points, n_control_points, storage);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Regression Benchmark
+
+-> Runs a fixed suite of benchmarks several times and stores the samples in
+	a results file, ready to be compared against a baseline with
+	benchmark_compare.
+-> "throughput" benchmarks use a trivial error function, so they time the
+	generation loop itself (ThreadsDESolver::run, the thread handshake and
+	the migration step).
+-> "time_to_target" benchmarks time a full run until the best error
+	reaches 1e-8.
+-> "startup" benchmarks time a short job: building the solver and solving
+	its first generation.
+
+Usage:
+	regression_benchmark [--repetitions R] [--out FILE] [--seed S]
+
+*/
+
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <limits>
+
+#include "AnytimeBenchmark.hpp"
+#include "BenchmarkResults.hpp"
+
+using namespace pdebc::bench;
+
+template <int DIM>
+Problem<DIM> sphere() {
+	return Problem<DIM>{"sphere", 128, [](const std::array<double,DIM>& x) {
+		double e = 0;
+		for (int d = 0; d < DIM; ++d) {
+			e += x[d] * x[d];
+		}
+		return e;
+	}};
+}
+
+// Evaluations per second of the generation loop, initialization excluded.
+template <int DIM>
+double throughput(const Configuration& config, const uint32_t generations,
+	const uint64_t seed) {
+	using namespace std;
+	using Clock = chrono::steady_clock;
+	auto problem = sphere<DIM>();
+	Solver<DIM> solver(config,
+		makePopulationGenerator(problem.domain_limit, seed),
+		move(problem.calc_error),
+		[](const double& a, const double& b) { return a < b; },
+		seed);
+	// waits for the initial population
+	solver.de->getBestCandidate();
+
+	const auto start = Clock::now();
+	solver.de->solveNGenerations(generations);
+	const double secs = chrono::duration<double>(Clock::now() - start).count();
+	return config.pop_size * static_cast<double>(generations) / secs;
+}
+
+template <int DIM>
+double timeToTarget(const Configuration& config, const uint32_t max_generations,
+	const uint64_t seed) {
+	auto problem = sphere<DIM>();
+	const RunResult r = runOnce(config, problem, max_generations, seed);
+	const double t = std::get<1>(hittingTime(r, 1e-8));
+	// a run that misses the target counts as its whole length
+	return t < std::numeric_limits<double>::infinity() ? t : r.curve.back().seconds;
+}
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	uint32_t repetitions = 11;
+	string out = "results.txt";
+	uint64_t seed = 42;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const string k = argv[i];
+		if (k == "--repetitions") {
+			repetitions = stoul(argv[i + 1]);
+		} else if (k == "--out") {
+			out = argv[i + 1];
+		} else if (k == "--seed") {
+			seed = stoull(argv[i + 1]);
+		} else {
+			fprintf(stderr, "Unknown option '%s'\n", k.c_str());
+			return 1;
+		}
+	}
+
+	struct Entry {
+		string name;
+		Configuration config;
+		int dim;
+	};
+	const vector<Entry> throughput_suite{
+		{"sequential_p128_d2", {"", false, 1, 0.0, 128, 0.5, 0.8}, 2},
+		{"threads_n1_p128_d2", {"", true, 1, 0.8, 128, 0.5, 0.8}, 2},
+		{"threads_n4_p128_d2", {"", true, 4, 0.8, 128, 0.5, 0.8}, 2},
+		{"threads_n8_p128_d2", {"", true, 8, 0.8, 128, 0.5, 0.8}, 2},
+		{"threads_n4_p4096_d2", {"", true, 4, 0.8, 4096, 0.5, 0.8}, 2},
+		{"threads_n4_p4096_d8", {"", true, 4, 0.8, 4096, 0.5, 0.8}, 8},
+	};
+	const vector<Entry> target_suite{
+		{"sequential_p128_d2", {"", false, 1, 0.0, 128, 0.5, 0.8}, 2},
+		{"threads_n8_p128_d2", {"", true, 8, 0.8, 128, 0.5, 0.8}, 2},
+		{"threads_n4_p256_d8", {"", true, 4, 0.8, 256, 0.5, 0.8}, 8},
+	};
+
+	const vector<Entry> startup_suite{
+		{"sequential_p16_d2", {"", false, 1, 0.0, 16, 0.5, 0.8}, 2},
+		{"threads_n4_p32_d2", {"", true, 4, 0.8, 32, 0.5, 0.8}, 2},
+	};
+
+	vector<Measurement> results;
+	for (auto& e : throughput_suite) {
+		Measurement m{e.name, "throughput", true, {}};
+		const uint32_t generations = max(20u, 200000u / e.config.pop_size);
+		for (uint32_t r = 0; r < repetitions; ++r) {
+			const uint64_t s = runSeed(seed, r);
+			m.samples.push_back(e.dim == 2 ? throughput<2>(e.config, generations, s)
+				: throughput<8>(e.config, generations, s));
+		}
+		printf("%-24s %-16s median %.4g evals/s (noise %.1f%%)\n", m.benchmark.c_str(),
+			m.metric.c_str(), median(m.samples), 100 * relativeNoise(m.samples));
+		results.push_back(m);
+	}
+	for (auto& e : target_suite) {
+		Measurement m{e.name, "time_to_target", false, {}};
+		for (uint32_t r = 0; r < repetitions; ++r) {
+			const uint64_t s = runSeed(seed, r);
+			m.samples.push_back(e.dim == 2 ? timeToTarget<2>(e.config, 2000, s)
+				: timeToTarget<8>(e.config, 2000, s));
+		}
+		printf("%-24s %-16s median %.4g s (noise %.1f%%)\n", m.benchmark.c_str(),
+			m.metric.c_str(), median(m.samples), 100 * relativeNoise(m.samples));
+		results.push_back(m);
+	}
+
+	for (auto& e : startup_suite) {
+		Measurement m{e.name, "startup", false, {}};
+		for (uint32_t r = 0; r < repetitions; ++r) {
+			// median of many short jobs, a single one is too short to time
+			vector<double> jobs;
+			for (uint32_t j = 0; j < 50; ++j) {
+				jobs.push_back(get<1>(startupLatency(e.config, sphere<2>(), runSeed(seed + r, j))));
+			}
+			m.samples.push_back(median(jobs));
+		}
+		printf("%-24s %-16s median %.4g s (noise %.1f%%)\n", m.benchmark.c_str(),
+			m.metric.c_str(), median(m.samples), 100 * relativeNoise(m.samples));
+		results.push_back(m);
+	}
+
+	if (!writeResults(out, results, to_string(repetitions) + " repetitions, seed "
+		+ to_string(seed) + ", " + to_string(thread::hardware_concurrency()) + " hardware threads")) {
+		fprintf(stderr, "Could not write '%s'\n", out.c_str());
+		return 1;
+	}
+	printf("Results written to %s\n", out.c_str());
+	return 0;
+}
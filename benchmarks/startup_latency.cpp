@@ -0,0 +1,81 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+/*
+
+Startup Latency Benchmark
+
+-> Times many short jobs: building a solver, and building it plus solving
+	its first generation (which includes generating and evaluating the
+	initial population).
+-> ThreadsDE reuses the threads of the shared ThreadPool, so only the very
+	first job pays for creating them; it is reported apart.
+
+Usage:
+	startup_latency [--jobs N]
+
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <tuple>
+
+#include "AnytimeBenchmark.hpp"
+#include "Statistics.hpp"
+
+using namespace pdebc::bench;
+
+int main(int argc, char *argv[]) {
+	using namespace std;
+	uint32_t jobs = 200;
+	if (argc == 3 && string(argv[1]) == "--jobs") {
+		jobs = stoul(argv[2]);
+	} else if (argc != 1) {
+		fprintf(stderr, "Usage: %s [--jobs N]\n", argv[0]);
+		return 1;
+	}
+
+	Problem<2> problem{"sphere", 128, [](const array<double,2>& x) {
+		return x[0] * x[0] + x[1] * x[1];
+	}};
+	const vector<Configuration> configs{
+		{"sequential_p16", false, 1, 0.0, 16, 0.5, 0.8},
+		{"sequential_p128", false, 1, 0.0, 128, 0.5, 0.8},
+		{"threads_n1_p16", true, 1, 0.8, 16, 0.5, 0.8},
+		{"threads_n4_p32", true, 4, 0.8, 32, 0.5, 0.8},
+		{"threads_n8_p128", true, 8, 0.8, 128, 0.5, 0.8},
+	};
+
+	printf("%-18s %14s %14s %18s\n", "job", "first job us", "construct us", "first gen us");
+	for (auto& c : configs) {
+		vector<double> construct, first_generation;
+		double first_job = 0;
+		for (uint32_t j = 0; j < jobs; ++j) {
+			const auto t = startupLatency(c, problem, runSeed(1, j));
+			if (j == 0) {
+				first_job = get<1>(t);
+			}
+			construct.push_back(get<0>(t));
+			first_generation.push_back(get<1>(t));
+		}
+		printf("%-18s %14.2f %14.2f %18.2f\n", c.name.c_str(), 1e6 * first_job,
+			1e6 * median(construct), 1e6 * median(first_generation));
+	}
+	return 0;
+}
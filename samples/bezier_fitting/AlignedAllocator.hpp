@@ -0,0 +1,59 @@
+
+
+#ifndef ALIGNEDALLOCATOR_HPP_
+#define ALIGNEDALLOCATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// std::allocator returning ALIGNMENT aligned memory (64: a cache line and
+// a full AVX-512 register). Built on operator new, so it shows up in the
+// allocation accounting of the benchmarks.
+template <class T, std::size_t ALIGNMENT = 64>
+struct AlignedAllocator {
+	using value_type = T;
+
+	template <class U>
+	struct rebind {
+		using other = AlignedAllocator<U, ALIGNMENT>;
+	};
+
+	AlignedAllocator() {
+	}
+	template <class U>
+	AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) {
+	}
+
+	T* allocate(const std::size_t n) {
+		// room to align, plus the pointer operator new gave us
+		void* raw = ::operator new(n * sizeof(T) + ALIGNMENT + sizeof(void*));
+		const std::uintptr_t base =
+			reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+		const std::uintptr_t aligned = (base + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		reinterpret_cast<void**>(aligned)[-1] = raw;
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	void deallocate(T* p, const std::size_t) {
+		if (p) {
+			::operator delete(reinterpret_cast<void**>(p)[-1]);
+		}
+	}
+};
+
+template <class T, class U, std::size_t A>
+bool operator==(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) {
+	return true;
+}
+
+template <class T, class U, std::size_t A>
+bool operator!=(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) {
+	return false;
+}
+
+template <class T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif /* ALIGNEDALLOCATOR_HPP_ */
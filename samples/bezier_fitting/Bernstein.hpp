@@ -0,0 +1,20 @@
+
+
+#ifndef BERNSTEIN_HPP_
+#define BERNSTEIN_HPP_
+
+// All Bernstein polynomials of a degree at t, with the triangle
+// recurrence b^r_j = t b^{r-1}_{j-1} + (1-t) b^{r-1}_j
+inline void bernsteinBasis(const int degree, const double t, double* out) {
+	const double s = 1 - t;
+	out[0] = 1;
+	for (int r = 1; r <= degree; r++) {
+		out[r] = t * out[r - 1];
+		for (int j = r - 1; j > 0; j--) {
+			out[j] = t * out[j - 1] + s * out[j];
+		}
+		out[0] *= s;
+	}
+}
+
+#endif /* BERNSTEIN_HPP_ */
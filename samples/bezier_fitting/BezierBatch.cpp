@@ -0,0 +1,136 @@
+
+#include "BezierBatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "pdebc/SequentialDE.hpp"
+
+#include "ParallelFor.hpp"
+
+namespace {
+
+using CoordinateDE = pdebc::SequentialDE<double,2,double>;
+
+// Buffers of one worker, reused from curve to curve
+struct Workspace {
+	std::vector<double> length;
+	std::vector<BezierCurve::DataPoint> data;
+	std::vector<Vec2d> initial;
+	std::vector<std::unique_ptr<CoordinateDE>> des;
+};
+
+void solveWithDE(BezierCurve& curve, const std::vector<Vec2d>& points,
+	const BatchFitOptions& options, const uint64_t seed, Workspace& w) {
+	using namespace std;
+	// candidates are drawn around the data, whatever its units
+	Vec2d low = points.front();
+	Vec2d high = points.front();
+	for (const auto& p : points) {
+		for (int d = 0; d < 2; d++) {
+			low[d] = min(low[d], p[d]);
+			high[d] = max(high[d], p[d]);
+		}
+	}
+	const double extent = max(max(high[0] - low[0], high[1] - low[1]), 1e-9);
+	const double lower = min(low[0], low[1]) - extent / 2;
+	const double upper = max(high[0], high[1]) + extent / 2;
+
+	const int inner = curve.kNumberControlPoints_ - 2;
+	mt19937_64 seeds(seed);
+	w.des.clear();
+	for (int i = 0; i < inner; i++) {
+		mt19937_64 emt(seeds());
+		uniform_real_distribution<double> ud(lower, upper);
+		w.des.emplace_back(new CoordinateDE(options.population_size, 0.5, 0.8,
+			bind(ud, emt),
+			[&curve](const Vec2d& cp) {
+				return curve.calcErrorWithOptimizationCache(cp);
+			},
+			[](const double& a, const double& b) {
+				return a < b;
+			},
+			seeds()));
+	}
+	for (int g = 0; g < options.iterations; g++) {
+		for (int i = 0; i < inner; i++) {
+			curve.updateVariableCPForOptimizationCache(i + 1);
+			w.des[i]->solveOneGeneration();
+			curve.control_points_[i + 1] = get<1>(w.des[i]->getBestCandidate());
+		}
+	}
+}
+
+void fitCurve(const std::vector<Vec2d>& points, const BatchFitOptions& options,
+	const uint64_t seed, Workspace& w, BatchFit& fit) {
+	using namespace std;
+	const uint32_t count = points.size();
+	if (count < 2) {
+		fit.control_points_.assign(2, count ? points[0] : Vec2d{});
+		fit.error_ = 0;
+		return;
+	}
+	// chord length parameterization
+	w.length.assign(count, 0.0);
+	for (uint32_t k = 1; k < count; k++) {
+		const Vec2d& a = points[k - 1];
+		const Vec2d& b = points[k];
+		w.length[k] = w.length[k - 1] + hypot(b[0] - a[0], b[1] - a[1]);
+	}
+	w.data.resize(count);
+	for (uint32_t k = 0; k < count; k++) {
+		const double t = w.length.back() > 0 ? w.length[k] / w.length.back()
+			: k / static_cast<double>(count - 1);
+		w.data[k] = BezierCurve::DataPoint{t, points[k]};
+	}
+
+	const int cps = max(2, min<int>(options.control_points, count));
+	w.initial.resize(cps);
+	w.initial.front() = points.front();
+	w.initial.back() = points.back();
+	for (int i = 1; i + 1 < cps; i++) {
+		const double a = i / static_cast<double>(cps - 1);
+		for (int d = 0; d < 2; d++) {
+			w.initial[i][d] = (1 - a) * w.initial.front()[d] + a * w.initial.back()[d];
+		}
+	}
+	// small curves: the basis is stored without asking for the free memory
+	BezierCurve curve{w.data, w.initial, BasisStorage::Stored};
+	if (options.method == BatchMethod::LeastSquares) {
+		fit.error_ = curve.fitWithLeastSquares(options.iterations);
+	} else {
+		solveWithDE(curve, points, options, seed, w);
+		fit.error_ = curve.calcError();
+	}
+	if (options.polish_iterations > 0) {
+		fit.error_ = curve.polishWithLevenbergMarquardt(options.polish_iterations);
+	}
+	fit.control_points_ = curve.control_points_;
+}
+
+} // namespace
+
+std::vector<BatchFit> fitBezierBatch(
+	const std::vector<std::vector<Vec2d>>& curves,
+	const BatchFitOptions& options, pdebc::ThreadPool& pool) {
+	using namespace std;
+	vector<BatchFit> fits(curves.size());
+	vector<Workspace> workspaces(parallelWorkers(pool, curves.size()));
+	parallelForDynamic(pool, curves.size(),
+		[&](const size_t worker, const size_t i) {
+			seed_seq seq{static_cast<uint32_t>(options.seed),
+				static_cast<uint32_t>(options.seed >> 32),
+				static_cast<uint32_t>(i), static_cast<uint32_t>(i >> 32)};
+			uint32_t seed[2];
+			seq.generate(seed, seed + 2);
+			fitCurve(curves[i], options,
+				static_cast<uint64_t>(seed[0]) << 32 | seed[1],
+				workspaces[worker], fits[i]);
+		});
+	return fits;
+}
@@ -0,0 +1,53 @@
+
+
+#ifndef BEZIERBATCH_HPP_
+#define BEZIERBATCH_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "pdebc/ThreadPool.hpp"
+
+#include "BezierCurve.hpp"
+
+enum class BatchMethod {
+	// least squares with Newton reparameterization
+	LeastSquares,
+	// one SequentialDE per inner control point, searching them in turn
+	// against the optimization cache (as pypde, without its threads)
+	DifferentialEvolution
+};
+
+struct BatchFitOptions {
+	// per curve, fewer for curves with fewer data points
+	int control_points{4};
+	BatchMethod method{BatchMethod::LeastSquares};
+	// least-squares / Newton rounds, or DE generations
+	int iterations{8};
+	int population_size{32};
+	// Levenberg-Marquardt iterations after either method, 0 for none.
+	// Least squares with Newton steps alone converges slowly on curves
+	// far from their chord length parameterization.
+	int polish_iterations{20};
+	// the DE of curve i is seeded from seed and i only, so the results do
+	// not depend on the number of threads
+	uint64_t seed{42};
+};
+
+struct BatchFit {
+	std::vector<Vec2d> control_points_;
+	// calcError over the curve's own data points
+	double error_;
+};
+
+// Fits every curve of the batch, chord length parameterized, with its end
+// points pinned to the first and last data points. Each curve is fitted
+// by a single thread; the curves are handed out one at a time to the
+// threads of `pool`, each reusing its own buffers. fits[i] is the fit of
+// curves[i].
+std::vector<BatchFit> fitBezierBatch(
+	const std::vector<std::vector<Vec2d>>& curves,
+	const BatchFitOptions& options,
+	pdebc::ThreadPool& pool = pdebc::ThreadPool::shared());
+
+#endif /* BEZIERBATCH_HPP_ */
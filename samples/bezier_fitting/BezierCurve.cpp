@@ -1,164 +1,1692 @@
 
-
 #include "BezierCurve.hpp"
 
+#include <algorithm>
 #include <array>
 #include <tuple>
 #include <vector>
 #include <cmath>
-#include <functional>
 #include <cstdio>
+#include <unistd.h>
+
+#include "Bernstein.hpp"
+#include "BezierProjection.hpp"
+#include "Cholesky.hpp"
+#include "ParallelFor.hpp"
+#include "Summation.hpp"
+
+// Data points are processed in fixed size chunks, on the shared thread
+// pool once there are enough of them
+static constexpr size_t kChunkDataPoints{8192};
+static constexpr size_t kParallelDataPoints{65536};
+
+// Physical memory not in use, or the largest size_t where sysconf does
+// not report it
+static size_t availableMemory() {
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+	const long pages = sysconf(_SC_AVPHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGESIZE);
+	if (pages > 0 && page_size > 0) {
+		return static_cast<size_t>(pages) * static_cast<size_t>(page_size);
+	}
+#endif
+	return static_cast<size_t>(-1);
+}
 
+// Scratch of the calling thread, at least size doubles. It only grows, so
+// the recomputed basis tiles do not allocate once warmed up.
+static double* threadScratch(const size_t size) {
+	thread_local AlignedVector<double> scratch;
+	if (scratch.size() < size) {
+		scratch.resize(size);
+	}
+	return scratch.data();
+}
 
-BezierCurve::BezierCurve(
-	const std::vector<std::tuple<double,Vec2d>> data_points,
-	const std::vector<Vec2d> control_points) :
+
+template <int DIM>
+BezierCurveND<DIM>::BezierCurveND(
+	const std::vector<DataPoint> data_points,
+	const std::vector<Vec> control_points,
+	const BasisStorage storage) :
 		kNumberControlPoints_{static_cast<uint32_t>(control_points.size())},
-		data_points_{data_points},
-		control_points_{control_points} {
-	
-	initializeOptimizationCache();
+		kNumberDataPoints_{static_cast<uint32_t>(data_points.size())},
+		control_points_{control_points},
+		weights_(control_points.size(), 1.0),
+		rational_{false} {
+
+	loadDataPoints(data_points);
+	initializeOptimizationCache(nullptr, storage);
 
 }
 
-BezierCurve::~BezierCurve() {
+template <int DIM>
+BezierCurveND<DIM>::BezierCurveND(
+	const std::vector<DataPoint>& data_points,
+	const std::vector<Vec>& control_points,
+	const BernsteinPowers& powers,
+	const BasisStorage storage) :
+		kNumberControlPoints_{static_cast<uint32_t>(control_points.size())},
+		kNumberDataPoints_{static_cast<uint32_t>(data_points.size())},
+		control_points_{control_points},
+		weights_(control_points.size(), 1.0),
+		rational_{false} {
+
+	loadDataPoints(data_points);
+	initializeOptimizationCache(&powers, storage);
+
 }
 
-void BezierCurve::getCurveInT(const double parameterization_value, Vec2d& out) const {
-	int n = kNumberControlPoints_ - 1;
-	double Bx = 0;
-	double By = 0;
-	for (int i = 0; i < kNumberControlPoints_; i++) {
-		const double p1 = pow(parameterization_value, i);
-		const double p2 = pow(1 - parameterization_value, n - i);
-		const double b = binomial_cache_[n][i] * p1 * p2;
-		const Vec2d& v = control_points_[i];
-		Bx += b * v[0];
-		By += b * v[1];
+template <int DIM>
+void BezierCurveND<DIM>::loadDataPoints(
+	const std::vector<DataPoint>& data_points) {
+	parameterization_.resize(kNumberDataPoints_);
+	for (int d = 0; d < kDimensions; d++) {
+		data_coords_[d].resize(kNumberDataPoints_);
+	}
+	for (uint32_t k = 0; k < kNumberDataPoints_; k++) {
+		parameterization_[k] = std::get<0>(data_points[k]);
+		for (int d = 0; d < kDimensions; d++) {
+			data_coords_[d][k] = std::get<1>(data_points[k])[d];
+		}
 	}
-	out[0] = Bx;
-	out[1] = By;
 }
 
-double BezierCurve::calcError() const {
-	using namespace std;
-	Vec2d temp_curve_p;
-	double error{0.0};
+template <class DATA_POINT>
+BernsteinPowers::BernsteinPowers(
+	const std::vector<DATA_POINT>& data_points,
+	const int max_degree) :
+		kMaxDegree_{max_degree},
+		count_{static_cast<uint32_t>(data_points.size())} {
+	const size_t rows = static_cast<size_t>(kMaxDegree_) + 1;
+	t_pow_.resize(rows * count_);
+	s_pow_.resize(rows * count_);
+	for (uint32_t p = 0; p < count_; p++) {
+		t_pow_[p] = 1;
+		s_pow_[p] = 1;
+	}
+	for (size_t k = 1; k < rows; k++) {
+		double* t = t_pow_.data() + k * count_;
+		double* s = s_pow_.data() + k * count_;
+		const double* t1 = t - count_;
+		const double* s1 = s - count_;
+		for (uint32_t p = 0; p < count_; p++) {
+			const double v = std::get<0>(data_points[p]);
+			t[p] = t1[p] * v;
+			s[p] = s1[p] * (1 - v);
+		}
+	}
+}
+
+template <int DIM>
+BezierCurveND<DIM>::~BezierCurveND() {
+}
+
+template <int DIM>
+BasisStorage BezierCurveND<DIM>::basisStorage() const {
+	return storage_;
+}
 
-	for (auto& p : data_points_) {
-		double ll = get<0>(p);
-		getCurveInT(ll, temp_curve_p);
-		const double dx = get<1>(p)[0] - temp_curve_p[0];
-		error += dx * dx;
-		const double dy = get<1>(p)[1] - temp_curve_p[1];
-		error += dy * dy;
+template <int DIM>
+double BezierCurveND<DIM>::getParameterization(const int para_index) const {
+	return parameterization_[para_index];
+}
+
+template <int DIM>
+VecNd<DIM> BezierCurveND<DIM>::getDataPoint(const int para_index) const {
+	Vec p;
+	for (int d = 0; d < kDimensions; d++) {
+		p[d] = data_coords_[d][para_index];
+	}
+	return p;
+}
+
+// Degree up to which evaluateBezier runs its Horner-like form, O(CP):
+// the binomials are exact there. Above it they lose digits and overflow
+// from about 1030 control points, so de Casteljau takes over, O(CP^2)
+// but only convex combinations at any degree.
+static constexpr int kHornerMaxDegree{50};
+
+// Horner-like Bernstein evaluation: the powers of t and (1-t) and the
+// binomials are built incrementally, no pow() calls
+template <int DIM>
+static VecNd<DIM> evaluateBezier(const VecNd<DIM>* control_points,
+	const int number_control_points, const double t) {
+	const int n = number_control_points - 1;
+	if (n <= 0) {
+		return control_points[0];
+	}
+	if (n > kHornerMaxDegree) {
+		thread_local std::vector<VecNd<DIM>> levels;
+		levels.assign(control_points, control_points + n + 1);
+		for (int r = n; r > 0; r--) {
+			for (int i = 0; i < r; i++) {
+				for (int d = 0; d < DIM; d++) {
+					levels[i][d] += t * (levels[i + 1][d] - levels[i][d]);
+				}
+			}
+		}
+		return levels[0];
+	}
+	const double s = 1 - t;
+	double t_pow = 1;
+	double binomial = 1;
+	VecNd<DIM> B;
+	for (int d = 0; d < DIM; d++) {
+		B[d] = control_points[0][d] * s;
+	}
+	for (int i = 1; i < n; i++) {
+		t_pow *= t;
+		binomial = binomial * (n - i + 1) / i;
+		const VecNd<DIM>& v = control_points[i];
+		for (int d = 0; d < DIM; d++) {
+			B[d] = (B[d] + t_pow * binomial * v[d]) * s;
+		}
+	}
+	t_pow *= t;
+	for (int d = 0; d < DIM; d++) {
+		B[d] += t_pow * control_points[n][d];
+	}
+	return B;
+}
+
+template <int DIM>
+static double dot(const VecNd<DIM>& a, const VecNd<DIM>& b) {
+	double v = 0;
+	for (int d = 0; d < DIM; d++) {
+		v += a[d] * b[d];
+	}
+	return v;
+}
+
+// c[d][j] = data coordinate d of data point begin + j minus c[d][j]
+template <int DIM>
+static void residuals(const std::array<AlignedVector<double>, DIM>& data,
+	const size_t begin, const size_t m, double* const* c) {
+	for (int d = 0; d < DIM; d++) {
+		const double* x = data[d].data() + begin;
+		double* cd = c[d];
+		for (size_t j = 0; j < m; j++) {
+			cd[j] = x[j] - cd[j];
+		}
+	}
+}
+
+// v[0][j] = |v[.][j]|^2, one coordinate per pass so each pass vectorizes
+template <int DIM>
+static void squaredNorms(double* const* v, const size_t m) {
+	double* out = v[0];
+	for (size_t j = 0; j < m; j++) {
+		out[j] *= out[j];
+	}
+	for (int d = 1; d < DIM; d++) {
+		const double* vd = v[d];
+		for (size_t j = 0; j < m; j++) {
+			out[j] += vd[j] * vd[j];
+		}
+	}
+}
+
+// Bernstein basis of degree n at the m t-values, with the recurrence of
+// bernsteinBasis run in place in the columns: polynomial i at t[j] is
+// columns[i * stride + j]. Every step is a convex combination: no
+// binomials, no pow(), no overflow or cancellation at any degree.
+static void bernsteinTile(const int n, const double* t, const size_t m,
+	double* columns, const size_t stride) {
+	double* c0 = columns;
+	for (size_t j = 0; j < m; j++) {
+		c0[j] = 1;
+	}
+	for (int r = 1; r <= n; r++) {
+		double* cr = columns + r * stride;
+		const double* cl = cr - stride;
+		for (size_t j = 0; j < m; j++) {
+			cr[j] = t[j] * cl[j];
+		}
+		for (int i = r - 1; i > 0; i--) {
+			double* ci = columns + i * stride;
+			const double* cp = ci - stride;
+			for (size_t j = 0; j < m; j++) {
+				ci[j] = t[j] * cp[j] + (1 - t[j]) * ci[j];
+			}
+		}
+		for (size_t j = 0; j < m; j++) {
+			c0[j] *= 1 - t[j];
+		}
+	}
+}
+
+// The rational basis of the weights from a Bernstein basis tile, in place:
+// b_i <- w_i b_i / sum_j w_j b_j, m <= kSumBlock
+static void rationalTile(const double* weights, const int n, const size_t m,
+	double* columns, const size_t stride) {
+	double denominator[kSumBlock];
+	for (size_t j = 0; j < m; j++) {
+		denominator[j] = 0;
+	}
+	for (int i = 0; i <= n; i++) {
+		const double w = weights[i];
+		const double* c = columns + i * stride;
+		for (size_t j = 0; j < m; j++) {
+			denominator[j] += w * c[j];
+		}
+	}
+	for (size_t j = 0; j < m; j++) {
+		denominator[j] = 1 / denominator[j];
+	}
+	for (int i = 0; i <= n; i++) {
+		const double w = weights[i];
+		double* c = columns + i * stride;
+		for (size_t j = 0; j < m; j++) {
+			c[j] *= w * denominator[j];
+		}
+	}
+}
+
+// Homogeneous control points (w_i P_i, w_i) of a rational curve, in a
+// buffer of the calling thread reused by the next call
+template <int DIM>
+static const std::vector<VecNd<DIM + 1>>& homogeneousControlPoints(
+	const VecNd<DIM>* control_points, const double* weights, const int count) {
+	thread_local std::vector<VecNd<DIM + 1>> homogeneous;
+	homogeneous.resize(count);
+	for (int i = 0; i < count; i++) {
+		for (int d = 0; d < DIM; d++) {
+			homogeneous[i][d] = weights[i] * control_points[i][d];
+		}
+		homogeneous[i][DIM] = weights[i];
+	}
+	return homogeneous;
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::getCurveInT(const double parameterization_value, Vec& out) const {
+	if (!rational_) {
+		out = evaluateBezier<DIM>(control_points_.data(), kNumberControlPoints_,
+			parameterization_value);
+		return;
+	}
+	const VecNd<DIM + 1> a = evaluateBezier<DIM + 1>(homogeneousControlPoints<DIM>(
+		control_points_.data(), weights_.data(), kNumberControlPoints_).data(),
+		kNumberControlPoints_, parameterization_value);
+	for (int d = 0; d < kDimensions; d++) {
+		out[d] = a[d] / a[kDimensions];
+	}
+}
+
+// evaluateBezier at count t-values, out[d][j] is coordinate d of the
+// curve at t[j]
+template <int DIM>
+static void evaluateBezier(const VecNd<DIM>* control_points,
+	const int number_control_points, const double* parameterization_values,
+	const size_t count, double* const* out) {
+	// Same recurrence as above, but control points are the outer loop
+	// so the inner loops run over a tile of t-values and vectorize
+	constexpr size_t kTile{256};
+	const int n = number_control_points - 1;
+	double s[kTile];
+	double t_pow[kTile];
+	// de Casteljau above kHornerMaxDegree, one coordinate at a time:
+	// row i of the levels holds point i at the tile's t-values
+	double* levels = nullptr;
+	if (n > kHornerMaxDegree) {
+		thread_local AlignedVector<double> scratch;
+		scratch.resize(static_cast<size_t>(n + 1) * kTile);
+		levels = scratch.data();
+	}
+	for (size_t begin = 0; begin < count; begin += kTile) {
+		const size_t m = count - begin < kTile ? count - begin : kTile;
+		const double* t = parameterization_values + begin;
+		if (n == 0) {
+			for (int d = 0; d < DIM; d++) {
+				for (size_t j = 0; j < m; j++) {
+					out[d][begin + j] = control_points[0][d];
+				}
+			}
+			continue;
+		}
+		if (levels) {
+			for (int d = 0; d < DIM; d++) {
+				for (int i = 0; i <= n; i++) {
+					double* row = levels + i * kTile;
+					const double p = control_points[i][d];
+					for (size_t j = 0; j < m; j++) {
+						row[j] = p;
+					}
+				}
+				for (int r = n; r > 0; r--) {
+					for (int i = 0; i < r; i++) {
+						double* row = levels + i * kTile;
+						const double* next = row + kTile;
+						for (size_t j = 0; j < m; j++) {
+							row[j] += t[j] * (next[j] - row[j]);
+						}
+					}
+				}
+				std::copy(levels, levels + m, out[d] + begin);
+			}
+			continue;
+		}
+		for (size_t j = 0; j < m; j++) {
+			s[j] = 1 - t[j];
+			t_pow[j] = 1;
+		}
+		for (int d = 0; d < DIM; d++) {
+			double* o = out[d] + begin;
+			const double p0 = control_points[0][d];
+			for (size_t j = 0; j < m; j++) {
+				o[j] = p0 * s[j];
+			}
+		}
+		double binomial = 1;
+		for (int i = 1; i < n; i++) {
+			binomial = binomial * (n - i + 1) / i;
+			for (size_t j = 0; j < m; j++) {
+				t_pow[j] *= t[j];
+			}
+			for (int d = 0; d < DIM; d++) {
+				double* o = out[d] + begin;
+				const double w = binomial * control_points[i][d];
+				for (size_t j = 0; j < m; j++) {
+					o[j] = (o[j] + t_pow[j] * w) * s[j];
+				}
+			}
+		}
+		for (int d = 0; d < DIM; d++) {
+			double* o = out[d] + begin;
+			const double pn = control_points[n][d];
+			for (size_t j = 0; j < m; j++) {
+				o[j] += t_pow[j] * t[j] * pn;
+			}
+		}
 	}
-	return error;
 }
 
-void BezierCurve::initializeOptimizationCache() {
-	using namespace std;
-	// First I optimize the p1 and p2 variables
-	const int dp_s = data_points_.size();
-	vector<vector<double>> p1_p2_caching;
-	p1_p2_caching.resize(dp_s);
 
-	for (auto i = p1_p2_caching.begin(); i != p1_p2_caching.end(); i++) {
-		i->resize(kNumberControlPoints_);
+// Control points of the derivative of the given order, a curve of
+// `count - order` control points (none once order >= count)
+template <int DIM>
+static void hodograph(std::vector<VecNd<DIM>>& control_points, const int order) {
+	for (int r = 0; r < order && !control_points.empty(); r++) {
+		const int n = control_points.size() - 1;
+		for (int i = 0; i < n; i++) {
+			for (int d = 0; d < DIM; d++) {
+				control_points[i][d] = n * (control_points[i + 1][d] - control_points[i][d]);
+			}
+		}
+		control_points.pop_back();
 	}
+}
 
-	for (int i = 0; i < dp_s; i++) {
-		for (int j = 0; j < kNumberControlPoints_; j++) {
-			const double pv = get<0>(data_points_[i]);
-			const double p1 = pow(pv, j);
-			const double p2 = pow(1 - pv,
-				kNumberControlPoints_ - 1 - j);
-			p1_p2_caching[i][j] = p1 * p2;
+// The rational curve and its derivatives up to `order` at the m <= kSumBlock
+// t-values. The homogeneous curve (A, W) = sum_i b_i (w_i P_i, w_i) and its
+// hodographs are evaluated first, then Leibniz's rule on A = W C gives
+//   C^(k) = (A^(k) - sum_{i=1}^k binomial(k, i) W^(i) C^(k-i)) / W
+// in place: row k (DIM + 1) + d of levels (kSumBlock doubles each) ends up
+// as coordinate d of C^(k), and row k (DIM + 1) + DIM holds W^(k).
+template <int DIM>
+static void evaluateRationalDerivatives(const std::vector<VecNd<DIM>>& control_points,
+	const std::vector<double>& weights, const int order, const double* t,
+	const size_t m, double* levels) {
+	constexpr int kRows{DIM + 1};
+	std::vector<VecNd<kRows>> homogeneous(homogeneousControlPoints<DIM>(
+		control_points.data(), weights.data(), control_points.size()));
+	for (int k = 0; k <= order; k++) {
+		double* rows[kRows];
+		for (int d = 0; d < kRows; d++) {
+			rows[d] = levels + (k * kRows + d) * kSumBlock;
+		}
+		if (homogeneous.empty()) {
+			for (int d = 0; d < kRows; d++) {
+				std::fill(rows[d], rows[d] + m, 0.0);
+			}
+		} else {
+			evaluateBezier<kRows>(homogeneous.data(), homogeneous.size(), t, m, rows);
+			hodograph<kRows>(homogeneous, 1);
 		}
 	}
+	const double* w = levels + DIM * kSumBlock;
+	for (int k = 0; k <= order; k++) {
+		for (int d = 0; d < DIM; d++) {
+			double* c = levels + (k * kRows + d) * kSumBlock;
+			for (int i = 1; i <= k; i++) {
+				const double binomial = binomialCoefficient(k, i);
+				const double* wi = levels + (i * kRows + DIM) * kSumBlock;
+				const double* ci = levels + ((k - i) * kRows + d) * kSumBlock;
+				for (size_t j = 0; j < m; j++) {
+					c[j] -= binomial * wi[j] * ci[j];
+				}
+			}
+			for (size_t j = 0; j < m; j++) {
+				c[j] /= w[j];
+			}
+		}
+	}
+}
 
-	// Second I calc the binomial cache
-	// 	There's no need to save it in memory...
-	function<long(int)> factorial;
-	factorial = [&factorial](int f) -> long {
-		if (f > 0) {
-			return f*factorial(f-1);
+template <int DIM>
+void BezierCurveND<DIM>::getCurveInT(const double* parameterization_values,
+	const size_t count, double* const* out) const {
+	if (!rational_) {
+		evaluateBezier<DIM>(control_points_.data(), kNumberControlPoints_,
+			parameterization_values, count, out);
+		return;
+	}
+	// the homogeneous curve, one tile at a time, divided by its weight
+	const std::vector<VecNd<DIM + 1>>& homogeneous = homogeneousControlPoints<DIM>(
+		control_points_.data(), weights_.data(), kNumberControlPoints_);
+	double weight[kSumBlock];
+	double* o[kDimensions + 1];
+	o[kDimensions] = weight;
+	for (size_t begin = 0; begin < count; begin += kSumBlock) {
+		const size_t m = count - begin < kSumBlock ? count - begin : kSumBlock;
+		for (int d = 0; d < kDimensions; d++) {
+			o[d] = out[d] + begin;
+		}
+		evaluateBezier<DIM + 1>(homogeneous.data(), kNumberControlPoints_,
+			parameterization_values + begin, m, o);
+		for (int d = 0; d < kDimensions; d++) {
+			double* od = o[d];
+			for (size_t j = 0; j < m; j++) {
+				od[j] /= weight[j];
+			}
+		}
+	}
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::getDerivativeInT(const int order,
+	const double* parameterization_values, const size_t count,
+	double* const* out) const {
+	if (rational_) {
+		if (order == 0) {
+			getCurveInT(parameterization_values, count, out);
+			return;
+		}
+		// unlike a polynomial one, it does not vanish above the degree
+		std::vector<double> levels((order + 1) * (kDimensions + 1) * kSumBlock);
+		for (size_t begin = 0; begin < count; begin += kSumBlock) {
+			const size_t m = count - begin < kSumBlock ? count - begin : kSumBlock;
+			evaluateRationalDerivatives<DIM>(control_points_, weights_, order,
+				parameterization_values + begin, m, levels.data());
+			for (int d = 0; d < kDimensions; d++) {
+				const double* c = levels.data()
+					+ (order * (kDimensions + 1) + d) * kSumBlock;
+				std::copy(c, c + m, out[d] + begin);
+			}
+		}
+		return;
+	}
+	std::vector<Vec> derivative(control_points_);
+	hodograph<DIM>(derivative, order);
+	if (derivative.empty()) {
+		for (int d = 0; d < kDimensions; d++) {
+			std::fill(out[d], out[d] + count, 0.0);
+		}
+		return;
+	}
+	evaluateBezier<DIM>(derivative.data(), derivative.size(),
+		parameterization_values, count, out);
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::sampleUniformly(const double t_begin, const double t_end,
+	const size_t count, double* const* out, const int order) const {
+	// one tile of t-values at a time, each from its index so the
+	// steps do not accumulate rounding
+	const double step = count > 1 ? (t_end - t_begin) / (count - 1) : 0;
+	double t[kSumBlock];
+	double* o[kDimensions];
+	for (size_t begin = 0; begin < count; begin += kSumBlock) {
+		const size_t m = count - begin < kSumBlock ? count - begin : kSumBlock;
+		for (size_t j = 0; j < m; j++) {
+			t[j] = t_begin + (begin + j) * step;
+		}
+		if (begin + m == count && count > 1) {
+			t[m - 1] = t_end;
+		}
+		for (int d = 0; d < kDimensions; d++) {
+			o[d] = out[d] + begin;
+		}
+		getDerivativeInT(order, t, m, o);
+	}
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::calcArcLengthTable(const size_t count, double* out) const {
+	// 5-point Gauss-Legendre on each interval: an O(h^10) error per
+	// interval where the speed is smooth, less accurate next to a cusp
+	static const double kNodes[5] = {-0.9061798459386640, -0.5384693101056831, 0.0,
+		0.5384693101056831, 0.9061798459386640};
+	static const double kWeights[5] = {0.2369268850561891, 0.4786286704993665,
+		0.5688888888888889, 0.4786286704993665, 0.2369268850561891};
+	constexpr size_t kIntervals{kSumBlock / 5};
+	if (count == 0) {
+		return;
+	}
+	out[0] = 0;
+	const size_t intervals = count - 1;
+	const double h = intervals > 0 ? 1.0 / intervals : 0;
+	std::vector<Vec> velocity(control_points_);
+	hodograph<DIM>(velocity, 1);
+	double t[kSumBlock];
+	double speed[kDimensions][kSumBlock];
+	double* v[kDimensions];
+	for (int d = 0; d < kDimensions; d++) {
+		v[d] = speed[d];
+	}
+	double length = 0;
+	for (size_t begin = 0; begin < intervals; begin += kIntervals) {
+		const size_t m = intervals - begin < kIntervals ? intervals - begin : kIntervals;
+		for (size_t i = 0; i < m; i++) {
+			const double middle = (begin + i + 0.5) * h;
+			for (int g = 0; g < 5; g++) {
+				t[5 * i + g] = middle + kNodes[g] * h / 2;
+			}
+		}
+		if (rational_) {
+			getDerivativeInT(1, t, 5 * m, v);
+			squaredNorms<DIM>(v, 5 * m);
+		} else if (velocity.empty()) {
+			for (size_t j = 0; j < 5 * m; j++) {
+				speed[0][j] = 0;
+			}
 		} else {
-			return (long)1;
+			evaluateBezier<DIM>(velocity.data(), velocity.size(), t, 5 * m, v);
+			squaredNorms<DIM>(v, 5 * m);
 		}
-	};
-	for (int n = 0; n < kMaxControlPoints; n++) {
-		for (int i = 0; i < kMaxControlPoints; i++) {
-			binomial_cache_[n][i] = factorial(n)
-			/ static_cast<double>(factorial(i) * factorial(n - i));
+		for (size_t i = 0; i < m; i++) {
+			double integral = 0;
+			for (int g = 0; g < 5; g++) {
+				integral += kWeights[g] * std::sqrt(speed[0][5 * i + g]);
+			}
+			length += integral * h / 2;
+			out[begin + i + 1] = length;
 		}
 	}
-	auto calcBinomial = [&factorial,this](const int i) -> double {
-		return factorial(this->kNumberControlPoints_-1)
-			/ static_cast<double>(factorial(i)
-				* factorial(this->kNumberControlPoints_-1 - i));
-	};
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcError() const {
+	// The curve is evaluated one summation block at a time
+	double curve[kDimensions][kSumBlock];
+	double* c[kDimensions];
+	for (int d = 0; d < kDimensions; d++) {
+		c[d] = curve[d];
+	}
+	const double* e = curve[0];
+	PairwiseAccumulator total;
+	for (size_t begin = 0; begin < kNumberDataPoints_; begin += kSumBlock) {
+		const size_t m = kNumberDataPoints_ - begin < kSumBlock
+			? kNumberDataPoints_ - begin : kSumBlock;
+		getCurveInT(parameterization_.data() + begin, m, c);
+		residuals<kDimensions>(data_coords_, begin, m, c);
+		squaredNorms<kDimensions>(c, m);
+		total.add(blockedSum(0, m, [e](const size_t j) {
+			return e[j];
+		}));
+	}
+	return total.result();
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcErrorWithInnerControlPoints(const double* inner) const {
+	// r = d - sum_i b_i P_i from the basis columns, one summation block
+	// at a time; every inner loop is contiguous
+	const int n = kNumberControlPoints_ - 1;
+	double* scratch = storage_ == BasisStorage::Recompute
+		? threadScratch(kNumberControlPoints_ * kSumBlock) : nullptr;
+	double r[kDimensions][kSumBlock];
+	double* rp[kDimensions];
+	for (int d = 0; d < kDimensions; d++) {
+		rp[d] = r[d];
+	}
+	const double* e = r[0];
+	PairwiseAccumulator total;
+	for (size_t begin = 0; begin < kNumberDataPoints_; begin += kSumBlock) {
+		const size_t m = kNumberDataPoints_ - begin < kSumBlock
+			? kNumberDataPoints_ - begin : kSumBlock;
+		for (int d = 0; d < kDimensions; d++) {
+			const double* x = data_coords_[d].data() + begin;
+			for (size_t j = 0; j < m; j++) {
+				r[d][j] = x[j];
+			}
+		}
+		size_t stride;
+		const double* tile = basisTile(begin, m, scratch, stride);
+		for (int i = 0; i <= n; i++) {
+			const bool pinned = i == 0 || i == n;
+			const double* b = tile + i * stride;
+			for (int d = 0; d < kDimensions; d++) {
+				const double p = pinned ? control_points_[i][d]
+					: inner[kDimensions * (i - 1) + d];
+				double* rd = r[d];
+				for (size_t j = 0; j < m; j++) {
+					rd[j] -= b[j] * p;
+				}
+			}
+		}
+		squaredNorms<kDimensions>(rp, m);
+		total.add(blockedSum(0, m, [e](const size_t j) {
+			return e[j];
+		}));
+	}
+	return total.result();
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::setWeights(const std::vector<double>& weights) {
+	weights_ = weights;
+	weights_.resize(kNumberControlPoints_, 1.0);
+	rational_ = false;
+	for (const double w : weights_) {
+		rational_ = rational_ || w != 1;
+	}
+	updateBasisCache();
+}
+
+template <int DIM>
+const std::vector<double>& BezierCurveND<DIM>::weights() const {
+	return weights_;
+}
+
+template <int DIM>
+bool BezierCurveND<DIM>::isRational() const {
+	return rational_;
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcErrorWithInnerControlPointsAndWeights(
+	const double* inner, const double* inner_weights) const {
+	// The cached basis is r_i = w_i b_i / W. The candidate weights v_i give
+	// the basis v_i b_i / V = q_i r_i / sum_j q_j r_j with q_i = v_i / w_i,
+	// so r = d - (sum_i q_i r_i P_i) / (sum_i q_i r_i), block by block
+	const int n = kNumberControlPoints_ - 1;
+	double* scratch = threadScratch(kNumberControlPoints_ * (kSumBlock + 1));
+	double* ratio = scratch + kNumberControlPoints_ * kSumBlock;
+	for (int i = 0; i <= n; i++) {
+		ratio[i] = i == 0 || i == n ? 1 : inner_weights[i - 1] / weights_[i];
+	}
+	double r[kDimensions][kSumBlock];
+	double* rp[kDimensions];
+	for (int d = 0; d < kDimensions; d++) {
+		rp[d] = r[d];
+	}
+	double denominator[kSumBlock];
+	const double* e = r[0];
+	PairwiseAccumulator total;
+	for (size_t begin = 0; begin < kNumberDataPoints_; begin += kSumBlock) {
+		const size_t m = kNumberDataPoints_ - begin < kSumBlock
+			? kNumberDataPoints_ - begin : kSumBlock;
+		for (size_t j = 0; j < m; j++) {
+			denominator[j] = 0;
+		}
+		for (int d = 0; d < kDimensions; d++) {
+			for (size_t j = 0; j < m; j++) {
+				r[d][j] = 0;
+			}
+		}
+		size_t stride;
+		const double* tile = basisTile(begin, m, scratch, stride);
+		for (int i = 0; i <= n; i++) {
+			const bool pinned = i == 0 || i == n;
+			const double* b = tile + i * stride;
+			const double q = ratio[i];
+			for (size_t j = 0; j < m; j++) {
+				denominator[j] += q * b[j];
+			}
+			for (int d = 0; d < kDimensions; d++) {
+				const double p = q * (pinned ? control_points_[i][d]
+					: inner[kDimensions * (i - 1) + d]);
+				double* rd = r[d];
+				for (size_t j = 0; j < m; j++) {
+					rd[j] += b[j] * p;
+				}
+			}
+		}
+		for (size_t j = 0; j < m; j++) {
+			denominator[j] = 1 / denominator[j];
+		}
+		for (int d = 0; d < kDimensions; d++) {
+			const double* x = data_coords_[d].data() + begin;
+			double* rd = r[d];
+			for (size_t j = 0; j < m; j++) {
+				rd[j] = x[j] - rd[j] * denominator[j];
+			}
+		}
+		squaredNorms<kDimensions>(rp, m);
+		total.add(blockedSum(0, m, [e](const size_t j) {
+			return e[j];
+		}));
+	}
+	return total.result();
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcOrthogonalError() const {
+	return orthogonalError(control_points_.data(), rational_ ? weights_.data() : nullptr);
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcOrthogonalErrorWithInnerControlPoints(
+	const double* inner) const {
+	thread_local std::vector<Vec> control_points;
+	control_points = control_points_;
+	for (uint32_t i = 1; i + 1 < kNumberControlPoints_; i++) {
+		for (int d = 0; d < kDimensions; d++) {
+			control_points[i][d] = inner[kDimensions * (i - 1) + d];
+		}
+	}
+	return orthogonalError(control_points.data(), rational_ ? weights_.data() : nullptr);
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcOrthogonalErrorWithInnerControlPointsAndWeights(
+	const double* inner, const double* inner_weights) const {
+	thread_local std::vector<Vec> control_points;
+	thread_local std::vector<double> weights;
+	control_points = control_points_;
+	weights = weights_;
+	for (uint32_t i = 1; i + 1 < kNumberControlPoints_; i++) {
+		for (int d = 0; d < kDimensions; d++) {
+			control_points[i][d] = inner[kDimensions * (i - 1) + d];
+		}
+		weights[i] = inner_weights[i - 1];
+	}
+	return orthogonalError(control_points.data(), weights.data());
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::orthogonalError(const Vec* control_points,
+	const double* weights) const {
+	// one projector per thread, so its buffers are reused
+	thread_local BezierProjectorND<DIM> projector;
+	projector.build(control_points, kNumberControlPoints_, weights);
+	double t[kSumBlock];
+	double distance[kSumBlock];
+	const double* x[kDimensions];
+	PairwiseAccumulator total;
+	for (size_t begin = 0; begin < kNumberDataPoints_; begin += kSumBlock) {
+		const size_t m = kNumberDataPoints_ - begin < kSumBlock
+			? kNumberDataPoints_ - begin : kSumBlock;
+		std::copy(parameterization_.data() + begin,
+			parameterization_.data() + begin + m, t);
+		for (int d = 0; d < kDimensions; d++) {
+			x[d] = data_coords_[d].data() + begin;
+		}
+		projector.project(x, m, t, distance);
+		total.add(blockedSum(0, m, [&distance](const size_t j) {
+			return distance[j];
+		}));
+	}
+	return total.result();
+}
 
-	// Then I can cache the part of the bezier curve equation
+template <int DIM>
+const double* BezierCurveND<DIM>::basisTile(const size_t begin, const size_t m,
+	double* scratch, size_t& stride) const {
+	if (storage_ == BasisStorage::Stored) {
+		stride = stride_;
+		return b_caching_.data() + begin;
+	}
+	stride = kSumBlock;
+	bernsteinTile(kNumberControlPoints_ - 1, parameterization_.data() + begin,
+		m, scratch, stride);
+	if (rational_) {
+		rationalTile(weights_.data(), kNumberControlPoints_ - 1, m, scratch, stride);
+	}
+	return scratch;
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::initializeOptimizationCache(const BernsteinPowers* powers,
+	const BasisStorage storage) {
+	using namespace std;
+	const int dp_s = kNumberDataPoints_;
+
+	// I cache the part of the bezier curve equation
 	// for all data points and
-	// control points
-	b_caching_.resize(dp_s);
-	for (auto i = b_caching_.begin(); i != b_caching_.end(); i++) {
-		i->resize(kNumberControlPoints_);
+	// control points, when it fits in memory.
+	// Columns are padded to a multiple of 8 doubles so each one
+	// starts on a 64-byte boundary
+	stride_ = (dp_s + 7) & ~7;
+	const size_t basis_bytes = static_cast<size_t>(stride_)
+		* kNumberControlPoints_ * sizeof(double);
+	storage_ = storage;
+	if (storage_ == BasisStorage::Auto) {
+		storage_ = basis_bytes <= availableMemory() / 4
+			? BasisStorage::Stored : BasisStorage::Recompute;
+	}
+	if (storage_ == BasisStorage::Stored) {
+		b_caching_.assign(static_cast<size_t>(stride_) * kNumberControlPoints_, 0.0);
+	} else {
+		variable_column_.assign(stride_, 0.0);
+	}
+	column_bb_.resize(kNumberControlPoints_);
+	gram_.resize(kNumberControlPoints_ * kNumberControlPoints_);
+	basis_dot_data_.resize(kNumberControlPoints_);
+	basis_sums_.resize(kNumberControlPoints_ * (kNumberControlPoints_ + 1)
+		+ kNumberControlPoints_ * kDimensions);
+	normal_matrix_.reserve(kNumberControlPoints_ * kNumberControlPoints_);
+	normal_rhs_.reserve(kNumberControlPoints_ * kDimensions);
+	derivative_control_points_.reserve(2 * kNumberControlPoints_);
+	homogeneous_control_points_.reserve(3 * kNumberControlPoints_);
+
+	for (int d = 0; d < kDimensions; d++) {
+		full_curve_[d].assign(stride_, 0.0);
 	}
-	for (int p = 0; p < dp_s; p++) {
-		for (int i = 0; i < kNumberControlPoints_; i++) {
-			b_caching_[p][i] = calcBinomial(i) * p1_p2_caching[p][i];
+	changed_control_points_.reserve(kNumberControlPoints_);
+	control_point_deltas_.reserve(kNumberControlPoints_);
+	const size_t n_chunks = (dp_s + kChunkDataPoints - 1) / kChunkDataPoints;
+	chunk_sums_.assign(n_chunks * kDimensions, 0.0);
+	updateBasisCache(storage_ == BasisStorage::Stored ? powers : nullptr);
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::updateBasisCache(const BernsteinPowers* powers) {
+	using namespace std;
+	const size_t dp_s = kNumberDataPoints_;
+	const int cps = kNumberControlPoints_;
+	const int n = cps - 1;
+	if (storage_ == BasisStorage::Stored) {
+		if (powers) {
+			for (int i = 0; i <= n; i++) {
+				const double binomial = binomialCoefficient(n, i);
+				const double* t = powers->t_pow_.data() + static_cast<size_t>(i) * dp_s;
+				const double* s = powers->s_pow_.data() + static_cast<size_t>(n - i) * dp_s;
+				double* c = b_caching_.data() + static_cast<size_t>(i) * stride_;
+				for (size_t p = 0; p < dp_s; p++) {
+					c[p] = binomial * t[p] * s[p];
+				}
+			}
+		} else {
+			for (size_t begin = 0; begin < dp_s; begin += kSumBlock) {
+				bernsteinTile(n, parameterization_.data() + begin,
+					min(kSumBlock, dp_s - begin), b_caching_.data() + begin, stride_);
+			}
+		}
+		if (rational_) {
+			for (size_t begin = 0; begin < dp_s; begin += kSumBlock) {
+				rationalTile(weights_.data(), n, min(kSumBlock, dp_s - begin),
+					b_caching_.data() + begin, stride_);
+			}
+		}
+	}
+
+	// sum of b^2 over the inner data points, and the normal equations of
+	// the least-squares fit over all data points. They only change with
+	// the parameterization. Summed one block at a time like blockedSum,
+	// so a recomputed basis tile is used once.
+	const size_t first = 1;
+	const size_t last = max(first, dp_s - 1);
+	PairwiseAccumulator* bb = basis_sums_.data();
+	PairwiseAccumulator* gram = bb + cps;
+	PairwiseAccumulator* bd = gram + cps * cps;
+	fill(basis_sums_.begin(), basis_sums_.end(), PairwiseAccumulator{});
+	double* scratch = storage_ == BasisStorage::Recompute
+		? threadScratch(cps * kSumBlock) : nullptr;
+	for (size_t begin = 0; begin < dp_s; begin += kSumBlock) {
+		const size_t m = min(kSumBlock, dp_s - begin);
+		size_t stride;
+		const double* tile = basisTile(begin, m, scratch, stride);
+		const size_t inner_begin = max(begin, first) - begin;
+		const size_t inner_end = max(inner_begin, min(begin + m, last) - begin);
+		for (int i = 0; i < cps; i++) {
+			const double* bi = tile + i * stride;
+			if (inner_begin < inner_end) {
+				bb[i].add(laneSum(inner_begin, inner_end, [bi](const size_t k) {
+					return bi[k] * bi[k];
+				}));
+			}
+			for (int j = 0; j <= i; j++) {
+				const double* bj = tile + j * stride;
+				gram[i * cps + j].add(laneSum(0, m, [bi, bj](const size_t k) {
+					return bi[k] * bj[k];
+				}));
+			}
+			for (int d = 0; d < kDimensions; d++) {
+				const double* x = data_coords_[d].data() + begin;
+				bd[i * kDimensions + d].add(laneSum(0, m, [bi, x](const size_t k) {
+					return bi[k] * x[k];
+				}));
+			}
+		}
+	}
+	for (int i = 0; i < cps; i++) {
+		column_bb_[i] = bb[i].result();
+		for (int j = 0; j <= i; j++) {
+			const double g = gram[i * cps + j].result();
+			gram_[i * cps + j] = g;
+			gram_[j * cps + i] = g;
+		}
+		for (int d = 0; d < kDimensions; d++) {
+			basis_dot_data_[i][d] = bd[i * kDimensions + d].result();
 		}
 	}
+
+	rebuildFullCurve();
 }
 
-void BezierCurve::updateVariableCPForOptimizationCache(
+template <int DIM>
+template <class BODY>
+void BezierCurveND<DIM>::forEachChunk(const BODY& body) const {
+	const size_t np = kNumberDataPoints_;
+	const size_t n_chunks = (np + kChunkDataPoints - 1) / kChunkDataPoints;
+	auto chunk = [&body, np](const size_t c) {
+		const size_t begin = c * kChunkDataPoints;
+		const size_t end = begin + kChunkDataPoints < np
+			? begin + kChunkDataPoints : np;
+		body(c, begin, end);
+	};
+	if (np >= kParallelDataPoints) {
+		parallelFor(pdebc::ThreadPool::shared(), n_chunks, chunk);
+	} else {
+		for (size_t c = 0; c < n_chunks; c++) {
+			chunk(c);
+		}
+	}
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::rebuildFullCurve() {
+	applied_control_points_ = control_points_;
+	deltas_since_refresh_ = 0;
+	const bool recompute = storage_ == BasisStorage::Recompute;
+	forEachChunk([this, recompute](const size_t, const size_t begin, const size_t end) {
+		double* scratch = recompute
+			? threadScratch(kNumberControlPoints_ * kSumBlock) : nullptr;
+		for (size_t tb = begin; tb < end; tb += kSumBlock) {
+			const size_t m = end - tb < kSumBlock ? end - tb : kSumBlock;
+			size_t stride;
+			const double* tile = basisTile(tb, m, scratch, stride);
+			for (int d = 0; d < kDimensions; d++) {
+				double* f = full_curve_[d].data() + tb;
+				for (size_t j = 0; j < m; j++) {
+					f[j] = 0;
+				}
+				for (uint32_t i = 0; i < kNumberControlPoints_; i++) {
+					const double* b = tile + i * stride;
+					const double v = applied_control_points_[i][d];
+					for (size_t j = 0; j < m; j++) {
+						f[j] += b[j] * v;
+					}
+				}
+			}
+		}
+	});
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::applyControlPointChanges() {
+	changed_control_points_.clear();
+	control_point_deltas_.clear();
+	for (uint32_t i = 0; i < kNumberControlPoints_; i++) {
+		if (control_points_[i] != applied_control_points_[i]) {
+			changed_control_points_.push_back(i);
+			Vec delta;
+			for (int d = 0; d < kDimensions; d++) {
+				delta[d] = control_points_[i][d] - applied_control_points_[i][d];
+			}
+			control_point_deltas_.push_back(delta);
+		}
+	}
+	if (changed_control_points_.empty()) {
+		return;
+	}
+	deltas_since_refresh_ += changed_control_points_.size();
+	if (deltas_since_refresh_ >= kFullCurveRefreshRounds * kNumberControlPoints_) {
+		rebuildFullCurve();
+		return;
+	}
+	for (const uint32_t i : changed_control_points_) {
+		applied_control_points_[i] = control_points_[i];
+	}
+	const bool recompute = storage_ == BasisStorage::Recompute;
+	forEachChunk([this, recompute](const size_t, const size_t begin, const size_t end) {
+		double* scratch = recompute
+			? threadScratch(kNumberControlPoints_ * kSumBlock) : nullptr;
+		for (size_t tb = begin; tb < end; tb += kSumBlock) {
+			const size_t m = end - tb < kSumBlock ? end - tb : kSumBlock;
+			size_t stride;
+			const double* tile = basisTile(tb, m, scratch, stride);
+			for (size_t c = 0; c < changed_control_points_.size(); c++) {
+				const double* b = tile + changed_control_points_[c] * stride;
+				for (int d = 0; d < kDimensions; d++) {
+					double* f = full_curve_[d].data() + tb;
+					const double v = control_point_deltas_[c][d];
+					for (size_t j = 0; j < m; j++) {
+						f[j] += b[j] * v;
+					}
+				}
+			}
+		}
+	});
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::updateVariableCPForOptimizationCache(
 	const int variable_control_point) {
-  // Then I cache the control points that will remain const
+  using namespace std;
   variable_control_point_ = variable_control_point;
-  const int np = data_points_.size();
-  const_control_point_.resize(np);
-  for (int p = 0; p < np; p++) {
-    double Bx = 0;
-    double By = 0;
-    for (int i = 0; i < kNumberControlPoints_; i++) {
-      if (i == variable_control_point) {
-        continue;
+  applyControlPointChanges();
+
+  // The control points that remain const are the full curve minus
+  // the variable one, c_k = f_k - b_k v. One pass gathers sum(b_k r_k)
+  // per chunk, over the same data points as calcErrorWithOptimizationCache,
+  // in the blocks of blockedSum so a recomputed tile is used once
+  const size_t np = kNumberDataPoints_;
+  const size_t first = 1;
+  const size_t last = max(first, np - 1);
+  const uint32_t column = variable_control_point_;
+  const Vec v = applied_control_points_[variable_control_point_];
+  const bool recompute = storage_ == BasisStorage::Recompute;
+  forEachChunk([&](const size_t chunk, const size_t begin, const size_t end) {
+    const size_t inner_begin = max(begin, first);
+    const size_t inner_end = max(inner_begin, min(end, last));
+    double* scratch = recompute
+      ? threadScratch(kNumberControlPoints_ * kSumBlock) : nullptr;
+    PairwiseAccumulator sums[kDimensions];
+    for (size_t tb = inner_begin; tb < inner_end; tb += kSumBlock) {
+      const size_t m = min(kSumBlock, inner_end - tb);
+      size_t stride;
+      const double* b = basisTile(tb, m, scratch, stride) + column * stride;
+      if (recompute) {
+        copy(b, b + m, variable_column_.data() + tb);
+      }
+      for (int d = 0; d < kDimensions; d++) {
+        const double* f = full_curve_[d].data() + tb;
+        const double* x = data_coords_[d].data() + tb;
+        const double vd = v[d];
+        sums[d].add(laneSum(0, m, [b, x, f, vd](const size_t k) {
+          return b[k] * (x[k] - (f[k] - b[k] * vd));
+        }));
       }
-      const double b = b_caching_[p][i];
-      const Vec2d& v = control_points_[i];
-      Bx += b * v[0];
-      By += b * v[1];
     }
-    const_control_point_[p][0] = Bx;
-    const_control_point_[p][1] = By;
+    for (int d = 0; d < kDimensions; d++) {
+      chunk_sums_[chunk * kDimensions + d] = sums[d].result();
+    }
+  });
+
+  VariableCPCacheND<DIM>& cache = variable_cp_cache_;
+  cache.sum_bb = column_bb_[variable_control_point_];
+  const size_t n_chunks = chunk_sums_.size() / kDimensions;
+  Vec sbr;
+  for (int d = 0; d < kDimensions; d++) {
+    PairwiseAccumulator acc;
+    for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+      acc.add(chunk_sums_[chunk * kDimensions + d]);
+    }
+    sbr[d] = acc.result();
+  }
+  if (cache.sum_bb > 0) {
+    for (int d = 0; d < kDimensions; d++) {
+      cache.best_cp[d] = sbr[d] / cache.sum_bb;
+    }
+  } else {
+    // the variable control point does not touch any inner data point
+    cache.best_cp = control_points_[variable_control_point_];
+  }
+
+  // The minimum is summed directly instead of expanding sum |r|^2 - ...,
+  // which would cancel catastrophically on good fits
+  const Vec best = cache.best_cp;
+  const double* column_base = recompute ? variable_column_.data()
+    : b_caching_.data() + static_cast<size_t>(column) * stride_;
+  forEachChunk([&](const size_t chunk, const size_t begin, const size_t end) {
+    const size_t inner_begin = max(begin, first);
+    const size_t inner_end = max(inner_begin, min(end, last));
+    PairwiseAccumulator sum;
+    for (size_t tb = inner_begin; tb < inner_end; tb += kSumBlock) {
+      const size_t m = min(kSumBlock, inner_end - tb);
+      const double* b = column_base + tb;
+      sum.add(laneSum(0, m, [&](const size_t k) {
+        double e = 0;
+        for (int d = 0; d < kDimensions; d++) {
+          const double c = full_curve_[d][tb + k] - b[k] * v[d];
+          const double r = data_coords_[d][tb + k] - (c + b[k] * best[d]);
+          e += r * r;
+        }
+        return e;
+      }));
+    }
+    chunk_sums_[chunk * kDimensions] = sum.result();
+  });
+  PairwiseAccumulator acc;
+  for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+    acc.add(chunk_sums_[chunk * kDimensions]);
+  }
+  cache.min_error = acc.result();
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcErrorWithOptimizationCache(const Vec& candidate_cp) const {
+	return variable_cp_cache_.calcError(candidate_cp);
+}
+
+template <int DIM>
+VecNd<DIM> BezierCurveND<DIM>::solveVariableCPWithOptimizationCache() const {
+	return variable_cp_cache_.best_cp;
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::getMinimumErrorWithOptimizationCache() const {
+	return variable_cp_cache_.min_error;
+}
+
+template <int DIM>
+VariableCPCacheND<DIM> BezierCurveND<DIM>::getVariableCPCache() const {
+	return variable_cp_cache_;
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::getCurveInTWithOptimizationCache(const int para_index,
+	const Vec& candidate_cp, Vec& out) const {
+  const double* row = nullptr;
+  if (storage_ == BasisStorage::Stored) {
+    row = b_caching_.data() + para_index;
+  } else {
+    double* basis = threadScratch(kNumberControlPoints_);
+    bernsteinBasis(kNumberControlPoints_ - 1, parameterization_[para_index], basis);
+    if (rational_) {
+      rationalTile(weights_.data(), kNumberControlPoints_ - 1, 1, basis, 1);
+    }
+    row = basis;
   }
+  const size_t stride = storage_ == BasisStorage::Stored ? stride_ : 1;
+  const double b = row[variable_control_point_ * stride];
+  const Vec& v = applied_control_points_[variable_control_point_];
+  for (int d = 0; d < kDimensions; d++) {
+    out[d] = candidate_cp[d] * b + (full_curve_[d][para_index] - b * v[d]);
+  }
+}
+
+template <int DIM>
+bool BezierCurveND<DIM>::solveControlPointsWithLeastSquares() {
+	// The first and last control points stay pinned, the inner ones
+	// solve  G_ff x = B_f^T d - G_f0 P_0 - G_fn P_n  (G = B^T B)
+	const int n = kNumberControlPoints_ - 1;
+	const int m = n - 1;
+	if (m <= 0) {
+		return true;
+	}
+	const Vec& p0 = control_points_[0];
+	const Vec& pn = control_points_[n];
+	normal_matrix_.resize(m * m);
+	normal_rhs_.resize(m * kDimensions);
+	for (int i = 0; i < m; i++) {
+		const double* g = gram_.data() + (i + 1) * kNumberControlPoints_;
+		for (int j = 0; j < m; j++) {
+			normal_matrix_[i * m + j] = g[j + 1];
+		}
+		for (int d = 0; d < kDimensions; d++) {
+			normal_rhs_[i * kDimensions + d] = basis_dot_data_[i + 1][d]
+				- g[0] * p0[d] - g[n] * pn[d];
+		}
+	}
+	// not enough data points for this many control points
+	if (!choleskyFactor(normal_matrix_, m)) {
+		return false;
+	}
+	for (int d = 0; d < kDimensions; d++) {
+		choleskySubstitute(normal_matrix_, m, normal_rhs_.data() + d, kDimensions);
+	}
+	for (int i = 0; i < m; i++) {
+		for (int d = 0; d < kDimensions; d++) {
+			control_points_[i + 1][d] = normal_rhs_[i * kDimensions + d];
+		}
+	}
+	return true;
 }
 
-double BezierCurve::calcErrorWithOptimizationCache(const Vec2d& candidate_cp) {
+template <int DIM>
+bool BezierCurveND<DIM>::solveControlPointsWithLeastSquares(const Vec* start_tangent,
+	const Vec* end_tangent) {
 	using namespace std;
-	const int DP = data_points_.size();
-
-	double ex = 0;
-	double ey = 0;
-	Vec2d temp_curve;
-	for (int k = 1; k < DP - 1; k++) {
-		getCurveInTWithOptimizationCache(k, candidate_cp, temp_curve);
-
-		const double dx = get<1>(data_points_[k])[0] - temp_curve[0];
-		const double dy = get<1>(data_points_[k])[1] - temp_curve[1];
-		ex += dx * dx;
-		ey += dy * dy;
-	}
-	return ex + ey;
-}
-
-void BezierCurve::getCurveInTWithOptimizationCache(const int para_index,
-	const Vec2d& candidate_cp, Vec2d& out) {
-  //const Vec2d& v = control_points_[variable_control_point_];
-  out[0] = candidate_cp[0] * b_caching_[para_index][variable_control_point_]
-      + const_control_point_[para_index][0];
-  out[1] = candidate_cp[1] * b_caching_[para_index][variable_control_point_]
-      + const_control_point_[para_index][1];
-}
\ No newline at end of file
+	const int n = kNumberControlPoints_ - 1;
+	if (n < 3 || (!start_tangent && !end_tangent)) {
+		return solveControlPointsWithLeastSquares();
+	}
+	// Each unknown z_a moves control point index[a] along direction[a]:
+	//   P_i = F_i + sum_{index[a] = i} z_a direction[a]
+	// with F the fixed part (the pinned end points, which the tangent
+	// constrained control points start from). Then the normal equations
+	// only need the Gram matrix:
+	//   sum_b G_{index[a] index[b]} (v_a . v_b) z_b
+	//     = v_a . (B^T d)_{index[a]} - sum_j G_{index[a] j} (v_a . F_j)
+	const Vec p0 = control_points_[0];
+	const Vec pn = control_points_[n];
+	Vec span;
+	for (int d = 0; d < kDimensions; d++) {
+		span[d] = pn[d] - p0[d];
+	}
+	const double chord = sqrt(dot<DIM>(span, span));
+	vector<Vec> fixed(kNumberControlPoints_, Vec{});
+	vector<int> index;
+	vector<Vec> direction;
+	fixed[0] = p0;
+	fixed[n] = pn;
+	auto build = [&](const bool scale_tangents) {
+		index.clear();
+		direction.clear();
+		for (int i = 1; i < n; i++) {
+			if (i == 1 && start_tangent) {
+				fixed[1] = p0;
+				if (scale_tangents) {
+					index.push_back(1);
+					direction.push_back(*start_tangent);
+				} else {
+					for (int d = 0; d < kDimensions; d++) {
+						fixed[1][d] += chord / 3 * (*start_tangent)[d];
+					}
+				}
+			} else if (i == n - 1 && end_tangent) {
+				fixed[n - 1] = pn;
+				if (scale_tangents) {
+					index.push_back(n - 1);
+					Vec backwards;
+					for (int d = 0; d < kDimensions; d++) {
+						backwards[d] = -(*end_tangent)[d];
+					}
+					direction.push_back(backwards);
+				} else {
+					for (int d = 0; d < kDimensions; d++) {
+						fixed[n - 1][d] -= chord / 3 * (*end_tangent)[d];
+					}
+				}
+			} else {
+				for (int d = 0; d < kDimensions; d++) {
+					Vec axis{};
+					axis[d] = 1;
+					index.push_back(i);
+					direction.push_back(axis);
+				}
+			}
+		}
+	};
+	vector<double> matrix;
+	vector<double> rhs;
+	auto solve = [&]() -> bool {
+		const int q = index.size();
+		matrix.assign(q * q, 0.0);
+		rhs.assign(q, 0.0);
+		for (int a = 0; a < q; a++) {
+			const Vec& va = direction[a];
+			const double* g = gram_.data() + index[a] * kNumberControlPoints_;
+			for (int b = 0; b < q; b++) {
+				const Vec& vb = direction[b];
+				matrix[a * q + b] = g[index[b]] * dot<DIM>(va, vb);
+			}
+			const Vec& bd = basis_dot_data_[index[a]];
+			rhs[a] = dot<DIM>(va, bd);
+			for (int j = 0; j <= n; j++) {
+				rhs[a] -= g[j] * dot<DIM>(va, fixed[j]);
+			}
+		}
+		if (!choleskyFactor(matrix, q)) {
+			return false;
+		}
+		choleskySubstitute(matrix, q, rhs.data(), 1);
+		return true;
+	};
+
+	build(true);
+	if (!solve()) {
+		return false;
+	}
+	// A tangent control point that would go backwards (or collapse onto
+	// its end point) is placed at a third of the chord instead
+	bool backwards = false;
+	for (size_t a = 0; a < index.size(); a++) {
+		const bool tangent = (index[a] == 1 && start_tangent)
+			|| (index[a] == n - 1 && end_tangent);
+		if (tangent && !(rhs[a] > 1e-6 * chord)) {
+			backwards = true;
+		}
+	}
+	if (backwards) {
+		build(false);
+		if (!solve()) {
+			return false;
+		}
+	}
+	for (int i = 1; i < n; i++) {
+		control_points_[i] = fixed[i];
+	}
+	for (size_t a = 0; a < index.size(); a++) {
+		for (int d = 0; d < kDimensions; d++) {
+			control_points_[index[a]][d] += rhs[a] * direction[a][d];
+		}
+	}
+	return true;
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::updateDerivativeControlPoints() {
+	// Control points of the first and second derivatives, stored one
+	// after the other
+	const int n = kNumberControlPoints_ - 1;
+	if (rational_) {
+		homogeneous_control_points_ = homogeneousControlPoints<DIM>(
+			control_points_.data(), weights_.data(), kNumberControlPoints_);
+		for (int r = 0; r < 2; r++) {
+			const int begin = homogeneous_control_points_.size() - (n + 1 - r);
+			for (int i = 0; i < n - r; i++) {
+				const VecNd<DIM + 1>& a = homogeneous_control_points_[begin + i];
+				const VecNd<DIM + 1>& b = homogeneous_control_points_[begin + i + 1];
+				VecNd<DIM + 1> v;
+				for (int d = 0; d <= kDimensions; d++) {
+					v[d] = (n - r) * (b[d] - a[d]);
+				}
+				homogeneous_control_points_.push_back(v);
+			}
+		}
+		return;
+	}
+	derivative_control_points_.clear();
+	for (int i = 0; i < n; i++) {
+		Vec v;
+		for (int d = 0; d < kDimensions; d++) {
+			v[d] = n * (control_points_[i + 1][d] - control_points_[i][d]);
+		}
+		derivative_control_points_.push_back(v);
+	}
+	for (int i = 0; i + 1 < n; i++) {
+		const Vec& a = derivative_control_points_[i];
+		const Vec& b = derivative_control_points_[i + 1];
+		Vec v;
+		for (int d = 0; d < kDimensions; d++) {
+			v[d] = (n - 1) * (b[d] - a[d]);
+		}
+		derivative_control_points_.push_back(v);
+	}
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::evaluateDerivatives(const double t, Vec& c, Vec& c1,
+	Vec& c2) const {
+	const int n = kNumberControlPoints_ - 1;
+	if (!rational_) {
+		const Vec* first = derivative_control_points_.data();
+		const Vec* second = first + n;
+		c = evaluateBezier<DIM>(control_points_.data(), kNumberControlPoints_, t);
+		c1 = n > 0 ? evaluateBezier<DIM>(first, n, t) : Vec{};
+		c2 = n > 1 ? evaluateBezier<DIM>(second, n - 1, t) : Vec{};
+		return;
+	}
+	// C = A / W, C' = (A' - W' C) / W, C'' = (A'' - 2 W' C' - W'' C) / W
+	const VecNd<DIM + 1>* first = homogeneous_control_points_.data() + n + 1;
+	const VecNd<DIM + 1>* second = first + n;
+	const VecNd<DIM + 1> a = evaluateBezier<DIM + 1>(
+		homogeneous_control_points_.data(), n + 1, t);
+	const VecNd<DIM + 1> a1 = n > 0 ? evaluateBezier<DIM + 1>(first, n, t)
+		: VecNd<DIM + 1>{};
+	const VecNd<DIM + 1> a2 = n > 1 ? evaluateBezier<DIM + 1>(second, n - 1, t)
+		: VecNd<DIM + 1>{};
+	const double w = a[kDimensions];
+	for (int d = 0; d < kDimensions; d++) {
+		c[d] = a[d] / w;
+		c1[d] = (a1[d] - a1[kDimensions] * c[d]) / w;
+		c2[d] = (a2[d] - 2 * a1[kDimensions] * c1[d] - a2[kDimensions] * c[d]) / w;
+	}
+}
+
+template <int DIM>
+void BezierCurveND<DIM>::reparameterizeWithNewton() {
+	updateDerivativeControlPoints();
+
+	// One Newton step on |C(t) - d|^2 per inner data point, the end
+	// points keep t = 0 and t = 1
+	const size_t last = kNumberDataPoints_ > 0 ? kNumberDataPoints_ - 1 : 0;
+	forEachChunk([&](const size_t, const size_t begin, const size_t end) {
+		for (size_t k = std::max<size_t>(begin, 1); k < std::min(end, last); k++) {
+			const double t = parameterization_[k];
+			Vec c;
+			Vec c1;
+			Vec c2;
+			evaluateDerivatives(t, c, c1, c2);
+			Vec r;
+			for (int d = 0; d < kDimensions; d++) {
+				r[d] = c[d] - data_coords_[d][k];
+			}
+			const double num = dot<DIM>(r, c1);
+			const double den = dot<DIM>(c1, c1) + dot<DIM>(r, c2);
+			if (den > 0) {
+				const double nt = t - num / den;
+				parameterization_[k] = nt < 0 ? 0 : (nt > 1 ? 1 : nt);
+			}
+		}
+	});
+	updateBasisCache();
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::fitWithLeastSquares(const int iterations) {
+	return fitWithLeastSquares(iterations, nullptr, nullptr);
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::fitWithLeastSquares(const int iterations,
+	const Vec* start_tangent, const Vec* end_tangent) {
+	for (int i = 0; i < iterations; i++) {
+		if (!solveControlPointsWithLeastSquares(start_tangent, end_tangent)) {
+			break;
+		}
+		reparameterizeWithNewton();
+	}
+	solveControlPointsWithLeastSquares(start_tangent, end_tangent);
+	return calcError();
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::calcMaxError(uint32_t& data_point) const {
+	double curve[kDimensions][kSumBlock];
+	double* c[kDimensions];
+	for (int d = 0; d < kDimensions; d++) {
+		c[d] = curve[d];
+	}
+	double max_error = 0;
+	data_point = 0;
+	for (size_t begin = 0; begin < kNumberDataPoints_; begin += kSumBlock) {
+		const size_t m = kNumberDataPoints_ - begin < kSumBlock
+			? kNumberDataPoints_ - begin : kSumBlock;
+		getCurveInT(parameterization_.data() + begin, m, c);
+		residuals<kDimensions>(data_coords_, begin, m, c);
+		squaredNorms<kDimensions>(c, m);
+		for (size_t j = 0; j < m; j++) {
+			if (curve[0][j] > max_error) {
+				max_error = curve[0][j];
+				data_point = begin + j;
+			}
+		}
+	}
+	return max_error;
+}
+
+template <int DIM>
+double BezierCurveND<DIM>::polishWithLevenbergMarquardt(const int max_iterations,
+	const double tolerance) {
+	using namespace std;
+	// Unknowns: the inner control points p (DIM m values) and the t-values
+	// of the inner data points. Each residual r_k = C(t_k) - d_k depends
+	// on p and on its own t_k only, so the t-block of the damped normal
+	// equations is diagonal (D) and is eliminated with the Schur
+	// complement S = A - E D^-1 E^T, leaving a DIM m x DIM m system.
+	// C is linear in p, so A = B^T B is exact; the t-terms keep their
+	// second order parts (r.C'' in D, b_i' r in E): with noisy data the
+	// residuals are not small and plain Gauss-Newton crawls along t.
+	const int n = kNumberControlPoints_ - 1;
+	const int m = n - 1;
+	const int np = kNumberDataPoints_;
+	if (m <= 0 || np < 3) {
+		return calcError();
+	}
+	const int q = kDimensions * m;
+	vector<double> schur(q * q);
+	vector<double> rhs(q);
+	// per data point: E's row, g_t = C'.r and the damped D_k
+	AlignedVector<double> coupling(static_cast<size_t>(np) * q);
+	AlignedVector<double> gt(np), dk(np);
+	AlignedVector<double> old_t(np);
+	vector<Vec> old_cp;
+	vector<double> basis(n + 1);
+	vector<double> lower(n);
+
+	double error = calcError();
+	double lambda = 1e-3;
+	for (int it = 0; it < max_iterations; it++) {
+		updateDerivativeControlPoints();
+
+		// A = G_ff (the same for every coordinate) plus damping
+		fill(schur.begin(), schur.end(), 0.0);
+		fill(rhs.begin(), rhs.end(), 0.0);
+		for (int i = 0; i < m; i++) {
+			for (int d = 0; d < kDimensions; d++) {
+				const int row = kDimensions * i + d;
+				for (int j = 0; j < m; j++) {
+					const double g = gram_[(i + 1) * kNumberControlPoints_ + j + 1];
+					schur[row * q + kDimensions * j + d] = g;
+				}
+				schur[row * q + row] *= 1 + lambda;
+			}
+		}
+		for (int k = 0; k < np; k++) {
+			const double t = parameterization_[k];
+			Vec c;
+			Vec c1;
+			Vec c2;
+			evaluateDerivatives(t, c, c1, c2);
+			Vec r;
+			for (int d = 0; d < kDimensions; d++) {
+				r[d] = c[d] - data_coords_[d][k];
+			}
+			// -g_p = -B^T r, with the basis row of this data point (the
+			// same values as the basis cache, stored or not)
+			bernsteinBasis(n, t, basis.data());
+			double weight = 1;
+			if (rational_) {
+				weight = 0;
+				for (int i = 0; i <= n; i++) {
+					weight += weights_[i] * basis[i];
+				}
+				rationalTile(weights_.data(), n, 1, basis.data(), 1);
+			}
+			for (int i = 0; i < m; i++) {
+				const double b = basis[i + 1];
+				for (int d = 0; d < kDimensions; d++) {
+					rhs[kDimensions * i + d] -= b * r[d];
+				}
+			}
+			// the end points keep their t-values
+			dk[k] = 0;
+			if (k == 0 || k == np - 1) {
+				continue;
+			}
+			const double jtj = dot<DIM>(c1, c1);
+			double h = jtj + dot<DIM>(r, c2);
+			if (!(h > 0)) {
+				h = jtj;
+			}
+			if (!(h > 0)) {
+				continue;
+			}
+			gt[k] = dot<DIM>(c1, r);
+			// t-values held at the bounds by their gradient stay there
+			if ((t <= 0 && gt[k] > 0) || (t >= 1 && gt[k] < 0)) {
+				continue;
+			}
+			dk[k] = h * (1 + lambda);
+
+			// b_i' = n (b^{n-1}_{i-1} - b^{n-1}_i), and for a rational
+			// basis r_i = w_i b_i / W, r_i' = (w_i b_i' - r_i W') / W
+			bernsteinBasis(n - 1, t, lower.data());
+			double weight_derivative = 0;
+			if (rational_) {
+				for (int i = 0; i <= n; i++) {
+					weight_derivative += weights_[i] * n
+						* ((i > 0 ? lower[i - 1] : 0) - (i < n ? lower[i] : 0));
+				}
+			}
+			double* e = coupling.data() + static_cast<size_t>(k) * q;
+			for (int i = 0; i < m; i++) {
+				const double b = basis[i + 1];
+				double db = n * (lower[i] - lower[i + 1]);
+				if (rational_) {
+					db = (weights_[i + 1] * db - b * weight_derivative) / weight;
+				}
+				for (int d = 0; d < kDimensions; d++) {
+					e[kDimensions * i + d] = b * c1[d] + db * r[d];
+				}
+			}
+			const double inv = 1 / dk[k];
+			for (int a = 0; a < q; a++) {
+				const double ea = e[a] * inv;
+				for (int b = 0; b < q; b++) {
+					schur[a * q + b] -= ea * e[b];
+				}
+				rhs[a] += ea * gt[k];
+			}
+		}
+
+		if (!choleskyFactor(schur, q)) {
+			lambda *= 10;
+			if (lambda > 1e12) {
+				break;
+			}
+			continue;
+		}
+		choleskySubstitute(schur, q, rhs.data(), 1);
+		const double* step = rhs.data();
+
+		// trial step, t_k moves by D_k^-1 (-g_t - E_k^T step)
+		old_cp = control_points_;
+		copy(parameterization_.begin(), parameterization_.end(), old_t.begin());
+		for (int i = 0; i < m; i++) {
+			for (int d = 0; d < kDimensions; d++) {
+				control_points_[i + 1][d] += step[kDimensions * i + d];
+			}
+		}
+		for (int k = 1; k < np - 1; k++) {
+			if (dk[k] > 0) {
+				const double* e = coupling.data() + static_cast<size_t>(k) * q;
+				double ep = 0;
+				for (int a = 0; a < q; a++) {
+					ep += e[a] * step[a];
+				}
+				const double nt = old_t[k] - (gt[k] + ep) / dk[k];
+				parameterization_[k] = nt < 0 ? 0 : (nt > 1 ? 1 : nt);
+			}
+		}
+
+		const double trial_error = calcError();
+		if (trial_error < error) {
+			const double gain = error - trial_error;
+			error = trial_error;
+			lambda = max(lambda / 3, 1e-12);
+			updateBasisCache();
+			if (gain <= tolerance * error) {
+				break;
+			}
+		} else {
+			control_points_ = old_cp;
+			copy(old_t.begin(), old_t.end(), parameterization_.begin());
+			lambda *= 4;
+			if (lambda > 1e12) {
+				break;
+			}
+		}
+	}
+	return error;
+}
+
+template BernsteinPowers::BernsteinPowers(
+	const std::vector<std::tuple<double,Vec2d>>& data_points, const int max_degree);
+template BernsteinPowers::BernsteinPowers(
+	const std::vector<std::tuple<double,Vec3d>>& data_points, const int max_degree);
+
+template <int DIM>
+constexpr int BezierCurveND<DIM>::kDimensions;
+template <int DIM>
+constexpr uint32_t BezierCurveND<DIM>::kFullCurveRefreshRounds;
+
+template struct BezierCurveND<2>;
+template struct BezierCurveND<3>;
@@ -4,46 +4,293 @@
 #define BEZIERCURVE_HPP_
 
 #include <array>
+#include <cstdint>
 #include <tuple>
 #include <vector>
 
-using Vec2d = std::array<double,2>;
+#include "AlignedAllocator.hpp"
+#include "Summation.hpp"
 
-struct BezierCurve {
+template <int DIM>
+using VecNd = std::array<double,DIM>;
+using Vec2d = VecNd<2>;
+using Vec3d = VecNd<3>;
 
-	static constexpr int kMaxControlPoints{20};
-	std::array<std::array<double, kMaxControlPoints>, kMaxControlPoints> binomial_cache_;
+// The O(1) error of one variable control point x, with the others fixed:
+//   E(x) = min_error + sum_bb |x - best_cp|^2
+// A copy stays valid while the other control points keep their values,
+// so several control points can be searched at the same time.
+template <int DIM>
+struct VariableCPCacheND {
+	double sum_bb;
+	VecNd<DIM> best_cp;
+	double min_error;
+
+	double calcError(const VecNd<DIM>& candidate_cp) const {
+		double distance = 0;
+		for (int d = 0; d < DIM; d++) {
+			const double delta = candidate_cp[d] - best_cp[d];
+			distance += delta * delta;
+		}
+		return min_error + sum_bb * distance;
+	}
+};
+using VariableCPCache = VariableCPCacheND<2>;
+
+// n choose k by the multiplicative recurrence, exact in double while the
+// products stay below 2^53 (n up to about 50) and never overflowing long
+constexpr double binomialCoefficient(const int n, const int k) {
+	return k < 0 || k > n ? 0
+		: (k == 0 ? 1 : binomialCoefficient(n, k - 1) * (n - k + 1) / k);
+}
+
+// Powers t^k and (1-t)^k, k in [0, max_degree], of the parameterization
+// of some data points: t^k of data point p is t_pow_[k * count_ + p].
+// Curves of several degrees over the same data build their first basis
+// cache from one shared table: O(n) per entry instead of the O(n^2)
+// recurrence. Keep max_degree moderate, t^k (1-t)^(n-k) underflows
+// where the recurrence does not.
+struct BernsteinPowers {
+	const int kMaxDegree_;
+	const uint32_t count_;
+	AlignedVector<double> t_pow_;
+	AlignedVector<double> s_pow_;
+
+	// DATA_POINT is BezierCurveND<DIM>::DataPoint
+	template <class DATA_POINT>
+	BernsteinPowers(const std::vector<DATA_POINT>& data_points,
+		const int max_degree);
+};
+
+// Where the Bernstein basis of the data points lives. Stored keeps a
+// DP x CP table, Recompute rebuilds it one summation block at a time
+// (O(CP^2) per data point) wherever it is needed, for datasets whose
+// table would not fit in memory. Both give bitwise the same results.
+// Auto stores the table when it takes at most a quarter of the available
+// physical memory.
+enum class BasisStorage {
+	Auto,
+	Stored,
+	Recompute
+};
+
+// Bezier curve fitted to data points of DIM coordinates. The kernels
+// loop over the coordinates with a compile-time bound, so each dimension
+// gets its own unrolled code; BezierCurve.cpp instantiates DIM = 2 and 3.
+template <int DIM>
+struct BezierCurveND {
+
+	static constexpr int kDimensions{DIM};
+	using Vec = VecNd<DIM>;
+	using DataPoint = std::tuple<double,Vec>;
 
 	const uint32_t kNumberControlPoints_;
-	const std::vector<std::tuple<double,Vec2d>> data_points_;
-	std::vector<Vec2d> control_points_;
+	const uint32_t kNumberDataPoints_;
+	std::vector<Vec> control_points_;
 
 
-	BezierCurve(
-		const std::vector<std::tuple<double,Vec2d>> data_points,
-		const std::vector<Vec2d> control_points
+	BezierCurveND(
+		const std::vector<DataPoint> data_points,
+		const std::vector<Vec> control_points,
+		const BasisStorage storage = BasisStorage::Auto
+		);
+	// Same, with the basis cache built from shared powers of the same
+	// data points (of degree at least control_points.size() - 1). The
+	// powers are not used when the basis is recomputed.
+	BezierCurveND(
+		const std::vector<DataPoint>& data_points,
+		const std::vector<Vec>& control_points,
+		const BernsteinPowers& powers,
+		const BasisStorage storage = BasisStorage::Auto
 		);
 
-	~BezierCurve();
+	~BezierCurveND();
+
+	// Stored or Recompute, as chosen at construction
+	BasisStorage basisStorage() const;
+	double getParameterization(const int para_index) const;
+	Vec getDataPoint(const int para_index) const;
 
-	void getCurveInT(const double parameterization_value, Vec2d& out) const;
+	void getCurveInT(const double parameterization_value, Vec& out) const;
+	// Batched getCurveInT: out[d][j] is coordinate d of the curve at
+	// parameterization_values[j]
+	void getCurveInT(const double* parameterization_values, const size_t count,
+		double* const* out) const;
+	// Same, for the derivative of the given order (0 is the curve itself)
+	void getDerivativeInT(const int order, const double* parameterization_values,
+		const size_t count, double* const* out) const;
+	// The curve, or its derivative of the given order, at `count` evenly
+	// spaced t-values from t_begin to t_end included: out[d][j] at
+	// t_begin + j (t_end - t_begin) / (count - 1). For rendering and
+	// resampling, O(CP) per point.
+	void sampleUniformly(const double t_begin, const double t_end,
+		const size_t count, double* const* out, const int order = 0) const;
+	// Arc length from t = 0 to each of `count` evenly spaced t-values in
+	// [0, 1]: out[0] = 0 and out[count - 1] is the length of the curve
+	void calcArcLengthTable(const size_t count, double* out) const;
 	double calcError() const;
+	// calcError of the curve whose inner control point i (in [1, CP - 2])
+	// has coordinates inner[DIM * (i - 1) + d]; the first and last
+	// control points are kept. Thread safe.
+	double calcErrorWithInnerControlPoints(const double* inner) const;
+	// Sum of the squared distances between the data points and the
+	// closest point of the curve, wherever it is rather than at their
+	// t-values: a good shape is not penalized for a poor parameterization.
+	// Newton starts from each data point's t-value (see BezierProjectorND),
+	// not from the t of the previous projection: the DE evaluates unrelated
+	// candidates one after the other, on any thread, and the error must not
+	// depend on which came before. The tree search makes up for a poor
+	// start. Thread safe.
+	double calcOrthogonalError() const;
+	double calcOrthogonalErrorWithInnerControlPoints(const double* inner) const;
+
+
+	/* Rational curve */
+	// Control point i gets the weight weights[i] > 0 and the curve becomes
+	//   C(t) = sum_i w_i b_i(t) P_i / sum_i w_i b_i(t)
+	// which also draws circular arcs and the other conics. With the weights
+	// fixed, C is still linear in the control points, in the basis
+	// w_i b_i / sum_j w_j b_j: the basis cache holds that one, so the
+	// optimization cache and the least-squares fits work unchanged.
+	// Every weight 1 (the default) is the polynomial curve. O(DP CP), like
+	// a reparameterization.
+	void setWeights(const std::vector<double>& weights);
+	const std::vector<double>& weights() const;
+	bool isRational() const;
+	// calcErrorWithInnerControlPoints with the weights of the inner control
+	// points too, inner_weights[i - 1] (> 0); the first and last weights
+	// are kept. For a DE searching the weights as extra dimensions: the
+	// cached basis is rescaled, at one division per data point more than
+	// with the weights fixed. Thread safe.
+	double calcErrorWithInnerControlPointsAndWeights(const double* inner,
+		const double* inner_weights) const;
+	// Same for calcOrthogonalError. The weights change how fast the curve
+	// is traversed, which the fixed t-values of the data points penalize:
+	// this error judges the shape alone.
+	double calcOrthogonalErrorWithInnerControlPointsAndWeights(const double* inner,
+		const double* inner_weights) const;
 
 
 	/* Optimization Cache */
+	// O(DP) per control point changed since the previous call, plus O(DP):
+	// only the changed control points are folded into the full curve
 	void updateVariableCPForOptimizationCache(const int variable_control_point);
 	void getCurveInTWithOptimizationCache(const int para_index,
-		const Vec2d& candidate_cp, Vec2d& out);
-	double calcErrorWithOptimizationCache(const Vec2d& candidate_cp);
+		const Vec& candidate_cp, Vec& out) const;
+	// O(1): the error is a quadratic in candidate_cp, see the cache below
+	double calcErrorWithOptimizationCache(const Vec& candidate_cp) const;
+	// Exact minimizer of calcErrorWithOptimizationCache and its error
+	Vec solveVariableCPWithOptimizationCache() const;
+	double getMinimumErrorWithOptimizationCache() const;
+	// Copy of the cache of the current variable control point
+	VariableCPCacheND<DIM> getVariableCPCache() const;
+
+
+	/* Least-squares fitting */
+	// Sets every inner control point to the exact least-squares fit for
+	// the current parameterization; the first and last ones are kept.
+	// Returns false (control points untouched) when the system is singular.
+	bool solveControlPointsWithLeastSquares();
+	// Same, but for G1 joins the second control point stays on the ray
+	// from the first one along start_tangent, and the last but one on the
+	// ray from the last one along -end_tangent. A null tangent is free.
+	// Tangents need at least 4 control points and are ignored below that.
+	bool solveControlPointsWithLeastSquares(const Vec* start_tangent,
+		const Vec* end_tangent);
+	// One Newton step per inner data point, moving its parameterization
+	// value to the closest point of the current curve. The variable
+	// control point must be updated again before using the cache.
+	void reparameterizeWithNewton();
+	// Alternates the two above and returns calcError()
+	double fitWithLeastSquares(const int iterations);
+	double fitWithLeastSquares(const int iterations, const Vec* start_tangent,
+		const Vec* end_tangent);
+	// Largest squared distance between a data point and the curve at its
+	// parameterization value, and that data point
+	double calcMaxError(uint32_t& data_point) const;
+	// Levenberg-Marquardt on the inner control points and the inner
+	// t-values together, from the current fit (e.g. the DE best
+	// candidates). Stops once an accepted step improves the error by less
+	// than tolerance (relative). Returns calcError(); as after
+	// reparameterizeWithNewton, the variable control point must be
+	// updated again before using the cache.
+	double polishWithLevenbergMarquardt(const int max_iterations,
+		const double tolerance = 1e-12);
 
 private:
+	// Data points as 64-byte aligned structure of arrays
+	AlignedVector<double> parameterization_;
+	std::array<AlignedVector<double>, kDimensions> data_coords_;
+	std::vector<double> weights_;
+	bool rational_;
+
 	/* Optimization Cache */
 	uint32_t variable_control_point_;
-	std::vector<std::vector<double>> b_caching_;
-	std::vector<Vec2d> const_control_point_;
+	// Bernstein basis (rational when the curve is), one aligned column per
+	// control point:
+	// basis of control point i at data point k is b_caching_[i * stride_ + k].
+	// Empty when the basis is recomputed, see basisTile.
+	BasisStorage storage_;
+	uint32_t stride_;
+	AlignedVector<double> b_caching_;
+	// Curve of every control point, as of applied_control_points_. The
+	// curve of the control points that remain const is full_curve_ minus
+	// the variable control point, computed where it is used.
+	std::array<AlignedVector<double>, kDimensions> full_curve_;
+	// Recompute only: basis of the variable control point at the inner
+	// data points, so its two passes build each tile once
+	AlignedVector<double> variable_column_;
+	std::vector<Vec> applied_control_points_;
+	// The deltas accumulate rounding, full_curve_ is rebuilt from scratch
+	// once they add up to kFullCurveRefreshRounds full rebuilds
+	static constexpr uint32_t kFullCurveRefreshRounds{16};
+	uint32_t deltas_since_refresh_;
+	std::vector<uint32_t> changed_control_points_;
+	std::vector<Vec> control_point_deltas_;
+	// sum of b_k^2 over the inner data points, per control point
+	std::vector<double> column_bb_;
+	// B^T B and B^T d of the Bernstein matrix B over all data points
+	std::vector<double> gram_;
+	std::vector<Vec> basis_dot_data_;
+	// Per entry block sums of column_bb_, gram_ and basis_dot_data_
+	std::vector<PairwiseAccumulator> basis_sums_;
+	std::vector<double> normal_matrix_;
+	std::vector<double> normal_rhs_;
+	std::vector<Vec> derivative_control_points_;
+	// rational: the homogeneous control points (w_i P_i, w_i) instead,
+	// then those of their first and second derivatives
+	std::vector<VecNd<DIM + 1>> homogeneous_control_points_;
+	// Per chunk partial sums, combined in chunk order so the result does
+	// not depend on how many threads ran the chunks
+	AlignedVector<double> chunk_sums_;
+	// With r_k = d_k - (full_curve_[k] - b_k applied_cp) and b_k the basis of the
+	// variable control point, the error of a candidate x is
+	//   E(x) = sum_k |r_k - b_k x|^2 = min_error + sum_bb |x - best_cp|^2
+	// (k over the inner data points), where best_cp = sum(b_k r_k) / sum_bb.
+	VariableCPCacheND<DIM> variable_cp_cache_;
 
 
-	void initializeOptimizationCache();
+	void loadDataPoints(const std::vector<DataPoint>& data_points);
+	// null weights for a polynomial curve
+	double orthogonalError(const Vec* control_points, const double* weights) const;
+	void initializeOptimizationCache(const BernsteinPowers* powers,
+		const BasisStorage storage);
+	// Basis of the data points [begin, begin + m), m <= kSumBlock: control
+	// point i at data point begin + j is tile[i * stride + j]. Points into
+	// b_caching_, or into scratch (CP x kSumBlock) once recomputed there.
+	const double* basisTile(const size_t begin, const size_t m,
+		double* scratch, size_t& stride) const;
+	void updateBasisCache(const BernsteinPowers* powers = nullptr);
+	void updateDerivativeControlPoints();
+	// C(t), C'(t) and C''(t), after updateDerivativeControlPoints
+	void evaluateDerivatives(const double t, Vec& c, Vec& c1, Vec& c2) const;
+	void rebuildFullCurve();
+	void applyControlPointChanges();
+	template <class BODY>
+	void forEachChunk(const BODY& body) const;
 };
 
-#endif /* BEZIERCURVE_HPP_ */
\ No newline at end of file
+using BezierCurve = BezierCurveND<2>;
+using BezierCurve3d = BezierCurveND<3>;
+
+#endif /* BEZIERCURVE_HPP_ */
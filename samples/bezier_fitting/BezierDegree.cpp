@@ -0,0 +1,91 @@
+
+#include "BezierDegree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "ParallelFor.hpp"
+
+DegreeSelection selectBezierDegree(const std::vector<Vec2d>& data_points,
+	const DegreeSelectionOptions& options, pdebc::ThreadPool& pool) {
+	using namespace std;
+	DegreeSelection selection;
+	const int n = data_points.size();
+	const int min_cps = max(2, options.min_control_points);
+	const int max_cps = max(min_cps, options.max_control_points);
+	const int candidates = max_cps - min_cps + 1;
+	selection.control_points_ = 0;
+	selection.errors_.assign(candidates, 0.0);
+	selection.max_errors_.assign(candidates, 0.0);
+	selection.scores_.assign(candidates, 0.0);
+	if (n < 2) {
+		return selection;
+	}
+
+	// Shared by every candidate: chord length parameterization and powers
+	vector<double> length(n, 0.0);
+	for (int k = 1; k < n; k++) {
+		const Vec2d& a = data_points[k - 1];
+		const Vec2d& b = data_points[k];
+		length[k] = length[k - 1] + hypot(b[0] - a[0], b[1] - a[1]);
+	}
+	vector<tuple<double,Vec2d>> data(n);
+	for (int k = 0; k < n; k++) {
+		const double t = length.back() > 0 ? length[k] / length.back()
+			: k / static_cast<double>(n - 1);
+		data[k] = tuple<double,Vec2d>{t, data_points[k]};
+	}
+	const BernsteinPowers powers{data, max_cps - 1};
+
+	vector<vector<Vec2d>> fits(candidates);
+	parallelFor(pool, candidates, [&](const size_t c) {
+		const int cps = min_cps + c;
+		vector<Vec2d> initial(cps);
+		for (int i = 0; i < cps; i++) {
+			const double a = i / static_cast<double>(cps - 1);
+			initial[i][0] = (1 - a) * data_points.front()[0] + a * data_points.back()[0];
+			initial[i][1] = (1 - a) * data_points.front()[1] + a * data_points.back()[1];
+		}
+		BezierCurve curve{data, initial, powers};
+		double error = curve.fitWithLeastSquares(0);
+		for (int i = 0; i < options.iterations; i++) {
+			const double previous = error;
+			error = curve.fitWithLeastSquares(1);
+			if (!(previous - error > options.convergence * previous)) {
+				break;
+			}
+		}
+		selection.errors_[c] = error;
+		uint32_t worst;
+		selection.max_errors_[c] = sqrt(curve.calcMaxError(worst));
+		fits[c] = curve.control_points_;
+	});
+
+	// BIC over the 2n residual coordinates, with 2 (cps - 2) free ones
+	const double observations = 2.0 * n;
+	const double floor = numeric_limits<double>::min();
+	int best = candidates - 1;
+	for (int c = 0; c < candidates; c++) {
+		const double parameters = 2.0 * (min_cps + c - 2);
+		selection.scores_[c] = observations
+			* log(max(selection.errors_[c] / observations, floor))
+			+ parameters * log(observations);
+	}
+	if (options.criterion == DegreeCriterion::BIC) {
+		best = min_element(selection.scores_.begin(), selection.scores_.end())
+			- selection.scores_.begin();
+	} else {
+		for (int c = 0; c < candidates; c++) {
+			if (selection.max_errors_[c] <= options.tolerance) {
+				best = c;
+				break;
+			}
+		}
+	}
+	selection.control_points_ = min_cps + best;
+	selection.best_ = move(fits[best]);
+	return selection;
+}
@@ -0,0 +1,55 @@
+
+
+#ifndef BEZIERDEGREE_HPP_
+#define BEZIERDEGREE_HPP_
+
+#include <vector>
+
+#include "pdebc/ThreadPool.hpp"
+
+#include "BezierCurve.hpp"
+
+enum class DegreeCriterion {
+	// Bayesian information criterion of the squared residuals:
+	// trades the error against the number of free coordinates
+	BIC,
+	// fewest control points whose worst data point is within tolerance
+	Tolerance
+};
+
+struct DegreeSelectionOptions {
+	int min_control_points{2};
+	int max_control_points{10};
+	DegreeCriterion criterion{DegreeCriterion::BIC};
+	// for DegreeCriterion::Tolerance, a distance
+	double tolerance{0.1};
+	// least-squares / Newton reparameterization rounds per candidate,
+	// stopping early once a round improves the error by less than
+	// `convergence` (relative). BIC needs converged fits, or it rewards
+	// the degrees that absorb the remaining parameterization error.
+	int iterations{100};
+	double convergence{1e-6};
+};
+
+// One fit per candidate control point count, index c for
+// min_control_points + c
+struct DegreeSelection {
+	int control_points_;
+	std::vector<Vec2d> best_;
+	std::vector<double> errors_;
+	std::vector<double> max_errors_;
+	std::vector<double> scores_;
+};
+
+// Fits every candidate degree concurrently on `pool` and picks one.
+// As everywhere else, the curves start and end at the first and last
+// data points.
+// The chord length parameterization and the powers of t and (1-t) are
+// computed once and shared by all the candidates. With
+// DegreeCriterion::Tolerance and no candidate within tolerance, the
+// largest one is picked.
+DegreeSelection selectBezierDegree(const std::vector<Vec2d>& data_points,
+	const DegreeSelectionOptions& options,
+	pdebc::ThreadPool& pool = pdebc::ThreadPool::shared());
+
+#endif /* BEZIERDEGREE_HPP_ */
@@ -0,0 +1,419 @@
+
+#include "BezierProjection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Point and first two derivatives of a bezier curve at u, by de Casteljau
+// in `levels` (count Vecs)
+template <int DIM>
+static void evaluateWithDerivatives(const VecNd<DIM>* control_points,
+	const int count, const double u, VecNd<DIM>* levels,
+	VecNd<DIM>& c, VecNd<DIM>& d1, VecNd<DIM>& d2) {
+	const int n = count - 1;
+	std::copy(control_points, control_points + count, levels);
+	d1 = VecNd<DIM>{};
+	d2 = VecNd<DIM>{};
+	for (int r = 0; r < n; r++) {
+		const int points = n + 1 - r;
+		for (int d = 0; d < DIM; d++) {
+			if (points == 3) {
+				d2[d] = n * (n - 1) * (levels[2][d] - 2 * levels[1][d] + levels[0][d]);
+			} else if (points == 2) {
+				d1[d] = n * (levels[1][d] - levels[0][d]);
+			}
+		}
+		for (int i = 0; i + 1 < points; i++) {
+			for (int d = 0; d < DIM; d++) {
+				levels[i][d] += u * (levels[i + 1][d] - levels[i][d]);
+			}
+		}
+	}
+	c = levels[0];
+}
+
+// Same for the rational curve of the projected control points and their
+// weights: the homogeneous curve A, W by de Casteljau in `levels`, then
+// C = A / W, C' = (A' - W' C) / W, C'' = (A'' - 2 W' C' - W'' C) / W
+template <int DIM>
+static void evaluateWithDerivatives(const VecNd<DIM>* control_points,
+	const double* weights, const int count, const double u,
+	VecNd<DIM + 1>* levels, VecNd<DIM>& c, VecNd<DIM>& d1, VecNd<DIM>& d2) {
+	for (int i = 0; i < count; i++) {
+		for (int d = 0; d < DIM; d++) {
+			levels[i][d] = weights[i] * control_points[i][d];
+		}
+		levels[i][DIM] = weights[i];
+	}
+	VecNd<DIM + 1> a;
+	VecNd<DIM + 1> a1;
+	VecNd<DIM + 1> a2;
+	evaluateWithDerivatives<DIM + 1>(levels, count, u, levels, a, a1, a2);
+	const double w = a[DIM];
+	for (int d = 0; d < DIM; d++) {
+		c[d] = a[d] / w;
+		d1[d] = (a1[d] - a1[DIM] * c[d]) / w;
+		d2[d] = (a2[d] - 2 * a1[DIM] * d1[d] - a2[DIM] * c[d]) / w;
+	}
+}
+
+template <int DIM>
+BezierProjectorND<DIM>::BezierProjectorND() :
+		count_{0} {
+
+}
+
+template <int DIM>
+void BezierProjectorND<DIM>::build(const Vec* control_points, const int count,
+	const double* weights) {
+	using namespace std;
+	count_ = count;
+	control_points_.assign(control_points, control_points + count);
+	if (weights) {
+		weights_.assign(weights, weights + count);
+	} else {
+		weights_.clear();
+	}
+	const int nodes = (2 << kDepth) - 1;
+	const int internal = (1 << kDepth) - 1;
+	low_.resize(nodes);
+	high_.resize(nodes);
+	node_control_points_.resize(static_cast<size_t>(nodes) * count);
+	node_weights_.assign(static_cast<size_t>(nodes) * count, 1.0);
+	split_.resize(count);
+	casteljau_.resize(count);
+	copy(control_points, control_points + count, node_control_points_.begin());
+	if (weights) {
+		copy(weights, weights + count, node_weights_.begin());
+	}
+	// de Casteljau at 1/2 on (w P, w), all weights 1 when polynomial
+	auto store = [](const Homogeneous& h, Vec& p, double& w) {
+		for (int d = 0; d < DIM; d++) {
+			p[d] = h[d] / h[DIM];
+		}
+		w = h[DIM];
+	};
+	for (int i = 0; i < internal; i++) {
+		const size_t offset = static_cast<size_t>(i) * count;
+		const Vec* p = node_control_points_.data() + offset;
+		const double* pw = node_weights_.data() + offset;
+		const size_t left = static_cast<size_t>(2 * i + 1) * count;
+		const size_t right = left + count;
+		Vec* lp = node_control_points_.data() + left;
+		Vec* rp = node_control_points_.data() + right;
+		double* lw = node_weights_.data() + left;
+		double* rw = node_weights_.data() + right;
+		for (int k = 0; k < count; k++) {
+			for (int d = 0; d < DIM; d++) {
+				split_[k][d] = pw[k] * p[k][d];
+			}
+			split_[k][DIM] = pw[k];
+		}
+		store(split_[0], lp[0], lw[0]);
+		store(split_[count - 1], rp[count - 1], rw[count - 1]);
+		for (int r = 1; r < count; r++) {
+			for (int k = 0; k + r < count; k++) {
+				for (int d = 0; d <= DIM; d++) {
+					split_[k][d] = (split_[k][d] + split_[k + 1][d]) / 2;
+				}
+			}
+			store(split_[0], lp[r], lw[r]);
+			store(split_[count - 1 - r], rp[count - 1 - r], rw[count - 1 - r]);
+		}
+	}
+	for (int i = 0; i < nodes; i++) {
+		const Vec* p = node_control_points_.data() + static_cast<size_t>(i) * count;
+		low_[i] = p[0];
+		high_[i] = p[0];
+		for (int k = 1; k < count; k++) {
+			for (int d = 0; d < DIM; d++) {
+				low_[i][d] = min(low_[i][d], p[k][d]);
+				high_[i][d] = max(high_[i][d], p[k][d]);
+			}
+		}
+	}
+	// the de Casteljau levels, then the two derivatives
+	levels_.resize(static_cast<size_t>(count + 2) * (DIM + 1) * kBlock);
+	best_t_.resize(kBlock);
+	step_.resize(kBlock);
+	converged_leaf_.resize(kBlock);
+	active_.resize((kDepth + 2) * kBlock);
+}
+
+template <int DIM>
+void BezierProjectorND<DIM>::refineBlock(const double* const* x, const size_t m,
+	double* t, double* distance) {
+	const int n = count_ - 1;
+	const bool rational = !weights_.empty();
+	const int rows = rational ? DIM + 1 : DIM;
+	double* levels = levels_.data();
+	double* d1 = levels + static_cast<size_t>(count_) * rows * kBlock;
+	double* d2 = d1 + rows * kBlock;
+	double* best_t = best_t_.data();
+	double* step = step_.data();
+	double f[kBlock];
+	double fp[kBlock];
+	for (size_t j = 0; j < m; j++) {
+		distance[j] = std::numeric_limits<double>::infinity();
+		best_t[j] = t[j];
+	}
+	if (n < 2) {
+		for (size_t j = 0; j < 2 * rows * kBlock; j++) {
+			d1[j] = 0;
+		}
+	}
+	for (int s = 0; ; s++) {
+		// de Casteljau on every point of the block, in place, one
+		// coordinate of one control point per pass
+		for (int i = 0; i <= n; i++) {
+			const double w = rational ? weights_[i] : 1;
+			for (int d = 0; d < rows; d++) {
+				double* row = levels + (i * rows + d) * kBlock;
+				const double p = d < DIM ? w * control_points_[i][d] : w;
+				for (size_t j = 0; j < m; j++) {
+					row[j] = p;
+				}
+			}
+		}
+		for (int r = 0; r < n; r++) {
+			const int points = n + 1 - r;
+			for (int d = 0; d < rows; d++) {
+				const double* l0 = levels + d * kBlock;
+				const double* l1 = levels + (rows + d) * kBlock;
+				if (points == 3) {
+					const double* l2 = levels + (2 * rows + d) * kBlock;
+					double* out = d2 + d * kBlock;
+					for (size_t j = 0; j < m; j++) {
+						out[j] = n * (n - 1) * (l2[j] - 2 * l1[j] + l0[j]);
+					}
+				} else if (points == 2) {
+					double* out = d1 + d * kBlock;
+					for (size_t j = 0; j < m; j++) {
+						out[j] = n * (l1[j] - l0[j]);
+					}
+				}
+			}
+			for (int i = 0; i + 1 < points; i++) {
+				for (int d = 0; d < rows; d++) {
+					double* li = levels + (i * rows + d) * kBlock;
+					const double* ln = li + rows * kBlock;
+					for (size_t j = 0; j < m; j++) {
+						li[j] += t[j] * (ln[j] - li[j]);
+					}
+				}
+			}
+		}
+		if (rational) {
+			// from the homogeneous curve A, W to C = A / W and its
+			// derivatives, as in evaluateWithDerivatives
+			const double* w = levels + DIM * kBlock;
+			const double* w1 = d1 + DIM * kBlock;
+			const double* w2 = d2 + DIM * kBlock;
+			for (int d = 0; d < DIM; d++) {
+				double* c = levels + d * kBlock;
+				double* a1 = d1 + d * kBlock;
+				double* a2 = d2 + d * kBlock;
+				for (size_t j = 0; j < m; j++) {
+					c[j] /= w[j];
+					a1[j] = (a1[j] - w1[j] * c[j]) / w[j];
+					a2[j] = (a2[j] - 2 * w1[j] * a1[j] - w2[j] * c[j]) / w[j];
+				}
+			}
+		}
+		// levels now holds C(t) - x, f = (C - x).C' and f' = |C'|^2 + (C - x).C''
+		for (size_t j = 0; j < m; j++) {
+			f[j] = 0;
+			fp[j] = 0;
+		}
+		for (int d = 0; d < DIM; d++) {
+			double* c = levels + d * kBlock;
+			const double* xd = x[d];
+			const double* a = d1 + d * kBlock;
+			const double* b = d2 + d * kBlock;
+			for (size_t j = 0; j < m; j++) {
+				c[j] -= xd[j];
+				f[j] += c[j] * a[j];
+				fp[j] += a[j] * a[j] + c[j] * b[j];
+			}
+		}
+		for (size_t j = 0; j < m; j++) {
+			double squared = 0;
+			for (int d = 0; d < DIM; d++) {
+				const double c = levels[d * kBlock + j];
+				squared += c * c;
+			}
+			if (squared < distance[j]) {
+				distance[j] = squared;
+				best_t[j] = t[j];
+				step[j] = fp[j] > 0 ? std::fabs(f[j] / fp[j]) : 1;
+			}
+		}
+		if (s == kNewtonSteps || n == 0) {
+			break;
+		}
+		for (size_t j = 0; j < m; j++) {
+			const double nt = fp[j] > 0 ? t[j] - f[j] / fp[j] : t[j];
+			t[j] = nt < 0 ? 0 : (nt > 1 ? 1 : nt);
+		}
+	}
+	for (size_t j = 0; j < m; j++) {
+		t[j] = best_t[j];
+	}
+}
+
+template <int DIM>
+void BezierProjectorND<DIM>::refineInLeaf(const int node, const Vec& x,
+	double& t, double& distance) {
+	const int leaf = node - ((1 << kDepth) - 1);
+	const double width = 1.0 / (1 << kDepth);
+	const double t0 = leaf * width;
+	const Vec* p = node_control_points_.data() + static_cast<size_t>(node) * count_;
+	const double* pw = node_weights_.data() + static_cast<size_t>(node) * count_;
+	// from the best point so far when it is in this leaf, else from the
+	// projection on the leaf's chord
+	double u;
+	if (t >= t0 && t <= t0 + width) {
+		u = (t - t0) / width;
+	} else {
+		double along = 0;
+		double length = 0;
+		for (int d = 0; d < DIM; d++) {
+			const double chord = p[count_ - 1][d] - p[0][d];
+			along += (x[d] - p[0][d]) * chord;
+			length += chord * chord;
+		}
+		u = length > 0 ? along / length : 0.5;
+		u = u < 0 ? 0 : (u > 1 ? 1 : u);
+	}
+	for (int step = 0; ; step++) {
+		Vec c;
+		Vec c1;
+		Vec c2;
+		if (weights_.empty()) {
+			evaluateWithDerivatives<DIM>(p, count_, u, casteljau_.data(), c, c1, c2);
+		} else {
+			evaluateWithDerivatives<DIM>(p, pw, count_, u, split_.data(), c, c1, c2);
+		}
+		double squared = 0;
+		double f = 0;
+		double fp = 0;
+		for (int d = 0; d < DIM; d++) {
+			const double r = c[d] - x[d];
+			squared += r * r;
+			f += r * c1[d];
+			fp += c1[d] * c1[d] + r * c2[d];
+		}
+		if (squared < distance) {
+			distance = squared;
+			t = t0 + u * width;
+		}
+		if (step == kNewtonSteps) {
+			break;
+		}
+		// where the distance is concave, its minimum over the leaf is at
+		// the end it decreases towards
+		double nu = fp > 0 ? u - f / fp : (f > 0 ? 0 : 1);
+		nu = nu < 0 ? 0 : (nu > 1 ? 1 : nu);
+		if (std::fabs(nu - u) <= kConverged) {
+			break;
+		}
+		u = nu;
+	}
+}
+
+template <int DIM>
+void BezierProjectorND<DIM>::project(const double* const* x, const size_t m,
+	double* t, double* distance) {
+	const int leaves = 1 << kDepth;
+	const int first_leaf = leaves - 1;
+	for (size_t begin = 0; begin < m; begin += kBlock) {
+		const size_t block = m - begin < kBlock ? m - begin : kBlock;
+		const double* xb[DIM];
+		for (int d = 0; d < DIM; d++) {
+			xb[d] = x[d] + begin;
+		}
+		double* tb = t + begin;
+		double* db = distance + begin;
+		refineBlock(xb, block, tb, db);
+		if (count_ < 2) {
+			continue;
+		}
+		// Newton already converged in its leaf, which has no other minimum
+		// unless the curve bends back within 1 / 2^kDepth of its length
+		uint32_t* all = active_.data();
+		for (size_t j = 0; j < block; j++) {
+			all[j] = j;
+			converged_leaf_[j] = step_[j] <= kConverged
+				? first_leaf + std::min(static_cast<int>(tb[j] * leaves), leaves - 1) : -1;
+		}
+		searchNode(0, 0, block, xb, tb, db);
+	}
+}
+
+template <int DIM>
+void BezierProjectorND<DIM>::searchNode(const int node, const int depth,
+	const size_t count, const double* const* x, double* t, double* distance) {
+	// the query points of the parent still closer to its box than to the
+	// curve, kept when also closer to this node's box
+	const uint32_t* parent = active_.data() + depth * kBlock;
+	uint32_t* active = active_.data() + (depth + 1) * kBlock;
+	size_t kept = 0;
+	for (size_t k = 0; k < count; k++) {
+		const uint32_t j = parent[k];
+		double bound = 0;
+		for (int d = 0; d < DIM; d++) {
+			const double below = low_[node][d] - x[d][j];
+			const double above = x[d][j] - high_[node][d];
+			const double gap = below > 0 ? below : (above > 0 ? above : 0);
+			bound += gap * gap;
+		}
+		active[kept] = j;
+		kept += bound < distance[j];
+	}
+	if (kept == 0) {
+		return;
+	}
+	if (depth == kDepth) {
+		for (size_t k = 0; k < kept; k++) {
+			const uint32_t j = active[k];
+			if (converged_leaf_[j] != node) {
+				Vec p;
+				for (int d = 0; d < DIM; d++) {
+					p[d] = x[d][j];
+				}
+				refineInLeaf(node, p, t[j], distance[j]);
+			}
+		}
+		return;
+	}
+	// The nearer child first, as seen from the first point: it tightens
+	// the distances before the farther one is tested. The points of a
+	// block are usually neighbours along the curve.
+	const int left = 2 * node + 1;
+	double left_gap = 0;
+	double right_gap = 0;
+	for (int d = 0; d < DIM; d++) {
+		const double p = x[d][active[0]];
+		const double l = (low_[left][d] + high_[left][d]) / 2 - p;
+		const double r = (low_[left + 1][d] + high_[left + 1][d]) / 2 - p;
+		left_gap += l * l;
+		right_gap += r * r;
+	}
+	const int nearer = left_gap <= right_gap ? left : left + 1;
+	searchNode(nearer, depth + 1, kept, x, t, distance);
+	searchNode(nearer == left ? left + 1 : left, depth + 1, kept, x, t, distance);
+}
+
+template <int DIM>
+constexpr int BezierProjectorND<DIM>::kDepth;
+template <int DIM>
+constexpr int BezierProjectorND<DIM>::kNewtonSteps;
+template <int DIM>
+constexpr double BezierProjectorND<DIM>::kConverged;
+template <int DIM>
+constexpr size_t BezierProjectorND<DIM>::kBlock;
+
+template struct BezierProjectorND<2>;
+template struct BezierProjectorND<3>;
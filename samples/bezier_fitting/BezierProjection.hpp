@@ -0,0 +1,94 @@
+
+
+#ifndef BEZIERPROJECTION_HPP_
+#define BEZIERPROJECTION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AlignedAllocator.hpp"
+#include "BezierCurve.hpp"
+
+// Closest points of a bezier curve to many query points.
+// build() halves the curve kDepth times (de Casteljau at 1/2) into a
+// complete binary tree; a piece of the curve lies in the convex hull of
+// its control points, so the box of those bounds it. project() first runs
+// Newton steps from the given t-values on a block of query points at a
+// time, one coordinate array per pass. The projector keeps no t-values
+// between calls, so a result depends on the curve and its inputs only. The block then descends the tree
+// together: a node keeps the points closer to its box than to the curve
+// point found so far, and in the leaves it reaches Newton runs again for
+// each of them. The result is the closest point, unless a leaf holds
+// several local minima.
+// A rational curve is split in homogeneous coordinates; with positive
+// weights its pieces stay in the convex hulls of their control points.
+template <int DIM>
+struct BezierProjectorND {
+
+	using Vec = VecNd<DIM>;
+
+	// 2^kDepth leaves
+	static constexpr int kDepth{5};
+	static constexpr int kNewtonSteps{3};
+	// Newton steps in t below this are converged
+	static constexpr double kConverged{1e-12};
+	static constexpr size_t kBlock{256};
+
+	BezierProjectorND();
+
+	// O(2^kDepth CP^2); the buffers of the previous curve are reused.
+	// weights (count of them, > 0) make the curve rational, null keeps it
+	// polynomial.
+	void build(const Vec* control_points, const int count,
+		const double* weights = nullptr);
+	// For the query points x[d][j], j in [0, m): t[j] is the starting
+	// t-value on input and the t-value of the closest point on output,
+	// distance[j] the squared distance to it
+	void project(const double* const* x, const size_t m, double* t,
+		double* distance);
+
+private:
+	using Homogeneous = VecNd<DIM + 1>;
+
+	int count_;
+	// empty when polynomial
+	std::vector<double> weights_;
+	std::vector<Vec> control_points_;
+	// per node: the box, then the control points of its piece of the
+	// curve (and their weights when rational); node i has children 2i + 1
+	// and 2i + 2
+	std::vector<Vec> low_;
+	std::vector<Vec> high_;
+	std::vector<Vec> node_control_points_;
+	std::vector<double> node_weights_;
+	// de Casteljau scratch of build and refineInLeaf
+	std::vector<Homogeneous> split_;
+	std::vector<Vec> casteljau_;
+	// Newton scratch: the de Casteljau levels of a block, coordinate d of
+	// point i at query point j is levels_[(i * rows + d) * kBlock + j], with
+	// rows = DIM, or DIM + 1 for the weight of a rational curve
+	AlignedVector<double> levels_;
+	AlignedVector<double> best_t_;
+	// last Newton step from best_t_, and the leaf of best_t_ when that
+	// step is converged (else -1)
+	AlignedVector<double> step_;
+	std::vector<int> converged_leaf_;
+	// query points of the block still to search, per tree depth
+	std::vector<uint32_t> active_;
+
+	void refineBlock(const double* const* x, const size_t m, double* t,
+		double* distance);
+	// Descends into `node` with the `count` query points of the block
+	// active at depth
+	void searchNode(const int node, const int depth, const size_t count,
+		const double* const* x, double* t, double* distance);
+	// Newton from the middle of leaf `node`; updates t and distance when
+	// closer
+	void refineInLeaf(const int node, const Vec& x, double& t, double& distance);
+};
+
+using BezierProjector = BezierProjectorND<2>;
+using BezierProjector3d = BezierProjectorND<3>;
+
+#endif /* BEZIERPROJECTION_HPP_ */
@@ -0,0 +1,265 @@
+
+#include "BezierSpline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <vector>
+
+#include "ParallelFor.hpp"
+
+namespace {
+
+// Turning angle at b, from a to c
+double turningAngle(const Vec2d& a, const Vec2d& b, const Vec2d& c) {
+	const double ux = b[0] - a[0], uy = b[1] - a[1];
+	const double vx = c[0] - b[0], vy = c[1] - b[1];
+	return std::atan2(std::fabs(ux * vy - uy * vx), ux * vx + uy * vy);
+}
+
+// Turning angle at data point i, over `window` neighbours on each side
+double turningAngle(const std::vector<Vec2d>& p, const int i, const int window) {
+	return turningAngle(p[i - window], p[i], p[i + window]);
+}
+
+// Mean of the data points [i - radius, i + radius]
+Vec2d meanPoint(const std::vector<Vec2d>& p, const int i, const int radius) {
+	Vec2d mean{{0, 0}};
+	for (int j = i - radius; j <= i + radius; j++) {
+		mean[0] += p[j][0];
+		mean[1] += p[j][1];
+	}
+	mean[0] /= 2 * radius + 1;
+	mean[1] /= 2 * radius + 1;
+	return mean;
+}
+
+// Same as turningAngle, between means of 2 radius + 1 data points: the
+// corner is the point farthest out, and alone its noise would add to
+// the turn
+double meanTurningAngle(const std::vector<Vec2d>& p, const int i,
+	const int window, const int radius) {
+	return turningAngle(meanPoint(p, i - window, radius), meanPoint(p, i, radius),
+		meanPoint(p, i + window, radius));
+}
+
+// Least ratio between the turns at half the window and at the window of a
+// corner; a circular bend gives about 1/2
+constexpr double kSharpness{0.75};
+
+std::vector<uint32_t> detectCorners(const std::vector<Vec2d>& p,
+	const SplineFitOptions& options) {
+	const int n = p.size();
+	const int w = std::max(1, options.window);
+	std::vector<double> angle(n, 0.0);
+	for (int i = w; i + w < n; i++) {
+		angle[i] = turningAngle(p, i, w);
+	}
+	// local maxima above the threshold, one per sharp turn
+	std::vector<uint32_t> corners;
+	for (int i = w; i + w < n; i++) {
+		if (angle[i] <= options.corner_angle) {
+			continue;
+		}
+		bool peak = true;
+		for (int j = std::max(0, i - w); j <= std::min(n - 1, i + w) && peak; j++) {
+			peak = angle[j] < angle[i] || (angle[j] == angle[i] && j >= i);
+		}
+		if (!peak) {
+			continue;
+		}
+		// The peak of the angle drifts towards the side that also curves.
+		// The corner itself is the point farthest from the chord, with the
+		// (signed) distances averaged over 2 spread + 1 points against
+		// the noise: a corner's peak stays where it is.
+		const Vec2d& a = p[i - w];
+		const Vec2d& c = p[i + w];
+		const double cx = c[0] - a[0], cy = c[1] - a[1];
+		auto distance = [&](const int j) {
+			return cx * (p[j][1] - a[1]) - cy * (p[j][0] - a[0]);
+		};
+		const int spread = std::min(w / 256, w - 1);
+		double sum = 0;
+		for (int j = i - w + 1; j <= i - w + 1 + 2 * spread; j++) {
+			sum += distance(j);
+		}
+		int corner = i;
+		double farthest = -1;
+		for (int j = i - w + 1 + spread; j + spread < i + w; j++) {
+			if (j > i - w + 1 + spread) {
+				sum += distance(j + spread) - distance(j - spread - 1);
+			}
+			if (std::fabs(sum) > farthest) {
+				farthest = std::fabs(sum);
+				corner = j;
+			}
+		}
+		// A corner turns at one point, the same at any scale. A bend turns
+		// along the window: at half the window it turns about half as much.
+		const int half = std::max(1, w / 2);
+		const int radius = w / 16;
+		if (corner - w - radius < 0 || corner + w + radius >= n) {
+			continue;
+		}
+		const double turn = meanTurningAngle(p, corner, w, radius);
+		const double half_turn = meanTurningAngle(p, corner, half, radius);
+		if (half_turn <= options.corner_angle || half_turn < kSharpness * turn) {
+			continue;
+		}
+		if (corners.empty() || corner > static_cast<int>(corners.back()) + w) {
+			corners.push_back(corner);
+		}
+	}
+	return corners;
+}
+
+// Unit tangent of the data at point i
+Vec2d dataTangent(const std::vector<Vec2d>& p, const int i, const int window) {
+	const int n = p.size();
+	const Vec2d& a = p[std::max(0, i - window)];
+	const Vec2d& b = p[std::min(n - 1, i + window)];
+	const double dx = b[0] - a[0], dy = b[1] - a[1];
+	const double l = std::hypot(dx, dy);
+	return l > 0 ? Vec2d{{dx / l, dy / l}} : Vec2d{{0, 0}};
+}
+
+struct Segment {
+	uint32_t begin;
+	uint32_t end;
+	bool has_start_tangent;
+	bool has_end_tangent;
+	Vec2d start_tangent;
+	Vec2d end_tangent;
+
+	// filled by fitSegment
+	std::vector<Vec2d> control_points;
+	double error;
+	double max_error;
+	uint32_t worst;
+};
+
+void fitSegment(const std::vector<Vec2d>& p, const SplineFitOptions& options,
+	Segment& s) {
+	using namespace std;
+	const uint32_t count = s.end - s.begin + 1;
+	// chord length parameterization of the segment
+	vector<double> length(count, 0.0);
+	for (uint32_t k = 1; k < count; k++) {
+		const Vec2d& a = p[s.begin + k - 1];
+		const Vec2d& b = p[s.begin + k];
+		length[k] = length[k - 1] + hypot(b[0] - a[0], b[1] - a[1]);
+	}
+	vector<tuple<double,Vec2d>> data(count);
+	for (uint32_t k = 0; k < count; k++) {
+		const double t = length.back() > 0 ? length[k] / length.back()
+			: k / static_cast<double>(max(1u, count - 1));
+		data[k] = tuple<double,Vec2d>{t, p[s.begin + k]};
+	}
+
+	// short pieces get as many control points as they have data points
+	const int cps = max(2, min<int>(options.control_points, count));
+	vector<Vec2d> initial(cps);
+	initial.front() = p[s.begin];
+	initial.back() = p[s.end];
+	for (int i = 1; i + 1 < cps; i++) {
+		const double a = i / static_cast<double>(cps - 1);
+		initial[i][0] = (1 - a) * initial.front()[0] + a * initial.back()[0];
+		initial[i][1] = (1 - a) * initial.front()[1] + a * initial.back()[1];
+	}
+	BezierCurve curve{data, initial};
+	s.error = curve.fitWithLeastSquares(options.iterations,
+		s.has_start_tangent ? &s.start_tangent : nullptr,
+		s.has_end_tangent ? &s.end_tangent : nullptr);
+	s.max_error = curve.calcMaxError(s.worst);
+	s.worst += s.begin;
+	s.control_points = curve.control_points_;
+}
+
+} // namespace
+
+BezierSpline fitBezierSpline(const std::vector<Vec2d>& data_points,
+	const SplineFitOptions& options, pdebc::ThreadPool& pool) {
+	using namespace std;
+	BezierSpline spline;
+	spline.max_error_ = 0;
+	const uint32_t n = data_points.size();
+	if (n < 2) {
+		return spline;
+	}
+	const bool g1 = options.continuity == SplineContinuity::G1;
+	const int w = max(1, options.window);
+	const double tolerance2 = options.tolerance * options.tolerance;
+	// pieces shorter than this are accepted as they are: splitting them
+	// further only chases noise and leaves too few points to hold a tangent
+	const uint32_t cps = max(2, options.control_points);
+	const uint32_t min_split = 2 * cps;
+
+	// Corners split the data first and are always C0 joins
+	spline.corners_ = detectCorners(data_points, options);
+	vector<uint32_t> cuts{0};
+	cuts.insert(cuts.end(), spline.corners_.begin(), spline.corners_.end());
+	cuts.push_back(n - 1);
+
+	vector<Segment> pending;
+	for (size_t c = 0; c + 1 < cuts.size(); c++) {
+		Segment s{};
+		s.begin = cuts[c];
+		s.end = cuts[c + 1];
+		pending.push_back(s);
+	}
+
+	// Rounds of parallel fits; a segment over tolerance splits at its worst
+	// data point and both halves are fitted in the next round
+	vector<Segment> accepted;
+	while (!pending.empty()) {
+		parallelFor(pool, pending.size(), [&](const size_t i) {
+			fitSegment(data_points, options, pending[i]);
+		});
+		vector<Segment> next;
+		for (auto& s : pending) {
+			if (s.max_error <= tolerance2 || s.end - s.begin < min_split) {
+				accepted.push_back(move(s));
+				continue;
+			}
+			// both halves keep cps data points, so they keep cps control
+			// points: with fewer the tangents of a G1 join would be
+			// dropped. min_split leaves room for that.
+			const uint32_t split = min(max(s.worst, s.begin + cps - 1), s.end - cps + 1);
+			Segment left{};
+			Segment right{};
+			left.begin = s.begin;
+			left.end = split;
+			right.begin = split;
+			right.end = s.end;
+			left.has_start_tangent = s.has_start_tangent;
+			left.start_tangent = s.start_tangent;
+			right.has_end_tangent = s.has_end_tangent;
+			right.end_tangent = s.end_tangent;
+			if (g1) {
+				// both sides of a new join share the tangent of the data
+				const Vec2d t = dataTangent(data_points, split, w);
+				const bool valid = t[0] != 0 || t[1] != 0;
+				left.has_end_tangent = valid;
+				left.end_tangent = t;
+				right.has_start_tangent = valid;
+				right.start_tangent = t;
+			}
+			next.push_back(move(left));
+			next.push_back(move(right));
+		}
+		pending = move(next);
+	}
+
+	sort(accepted.begin(), accepted.end(),
+		[](const Segment& a, const Segment& b) {
+			return a.begin < b.begin;
+		});
+	for (auto& s : accepted) {
+		spline.joints_.push_back(s.begin);
+		spline.segments_.push_back(move(s.control_points));
+		spline.errors_.push_back(s.error);
+		spline.max_error_ = max(spline.max_error_, sqrt(s.max_error));
+	}
+	spline.joints_.push_back(n - 1);
+	return spline;
+}
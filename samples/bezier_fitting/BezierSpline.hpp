@@ -0,0 +1,53 @@
+
+
+#ifndef BEZIERSPLINE_HPP_
+#define BEZIERSPLINE_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "pdebc/ThreadPool.hpp"
+
+#include "BezierCurve.hpp"
+
+// Continuity at the joins between segments that are not corners
+enum class SplineContinuity {
+	C0, // segments share their end points
+	G1  // and their tangent directions
+};
+
+struct SplineFitOptions {
+	// per segment: 4 is a cubic spline
+	int control_points{4};
+	// largest distance allowed between a data point and its segment
+	double tolerance{0.1};
+	// turning angle (radians) above which a data point is a corner; a turn
+	// spread over the window is a bend and not a corner
+	double corner_angle{1.0};
+	// neighbours on each side used to measure angles and tangents
+	int window{3};
+	SplineContinuity continuity{SplineContinuity::G1};
+	// least-squares / Newton reparameterization rounds per segment fit
+	int iterations{4};
+};
+
+// Composite bezier curve fitted to a polyline.
+// Segment s covers data points [joints_[s], joints_[s + 1]]; consecutive
+// segments share the data point at the join.
+struct BezierSpline {
+	std::vector<std::vector<Vec2d>> segments_;
+	std::vector<uint32_t> joints_;
+	std::vector<uint32_t> corners_;
+	// calcError of each segment over its own data points
+	std::vector<double> errors_;
+	double max_error_;
+};
+
+// Splits the data at corners, then fits the pieces and splits them at
+// their worst data point until every data point is within tolerance.
+// Each round fits all pending segments in parallel on `pool`.
+BezierSpline fitBezierSpline(const std::vector<Vec2d>& data_points,
+	const SplineFitOptions& options,
+	pdebc::ThreadPool& pool = pdebc::ThreadPool::shared());
+
+#endif /* BEZIERSPLINE_HPP_ */
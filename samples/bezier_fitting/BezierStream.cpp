@@ -0,0 +1,355 @@
+
+#include "BezierStream.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <vector>
+
+#include "Bernstein.hpp"
+#include "Cholesky.hpp"
+
+// The moments are summed again once the window has drifted by more than
+// this fraction of the interval they were summed over
+static constexpr double kMaxDrift{0.25};
+
+// Blossom of every Bernstein polynomial of a degree at (t0 x degree - k,
+// t1 x k): the coefficient k of the polynomial in the basis on another
+// interval. Multiplies by the factors (1 - x) + x one at a time.
+static void bernsteinBlossom(const int degree, const int k, const double t0,
+	const double t1, double* out) {
+	out[0] = 1;
+	for (int r = 1; r <= degree; r++) {
+		const double t = r <= degree - k ? t0 : t1;
+		const double s = 1 - t;
+		out[r] = t * out[r - 1];
+		for (int j = r - 1; j > 0; j--) {
+			out[j] = t * out[j - 1] + s * out[j];
+		}
+		out[0] *= s;
+	}
+}
+
+
+template <int DIM>
+BezierStreamND<DIM>::BezierStreamND(const uint32_t control_points) :
+		kNumberControlPoints_{control_points},
+		control_points_(control_points),
+		origin_{0},
+		scale_{0},
+		centre_{},
+		dd_{0},
+		updates_{0},
+		rebuild_size_{0} {
+	const int n = kNumberControlPoints_ - 1;
+	m_.assign(2 * n + 1, 0.0);
+	d_.assign(n + 1, Vec{});
+	gram_.assign(kNumberControlPoints_ * kNumberControlPoints_, 0.0);
+	basis_dot_data_.assign(kNumberControlPoints_, Vec{});
+	t_moments_.resize(2 * n + 1);
+	s_moments_.resize(n + 1);
+	basis_.resize(2 * n + 1);
+	normal_matrix_.reserve(kNumberControlPoints_ * kNumberControlPoints_);
+	normal_rhs_.reserve(kNumberControlPoints_ * DIM);
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::accumulate(const Vec& data_point, const double arc,
+	const double sign) {
+	const int n = kNumberControlPoints_ - 1;
+	const double u = scale_ > 0 ? (arc - origin_) / scale_ : 0;
+	Vec r;
+	double rr = 0;
+	for (int d = 0; d < DIM; d++) {
+		r[d] = data_point[d] - centre_[d];
+		rr += r[d] * r[d];
+	}
+	dd_ += sign * rr;
+	bernsteinBasis(2 * n, u, basis_.data());
+	for (int k = 0; k <= 2 * n; k++) {
+		m_[k] += sign * basis_[k];
+	}
+	bernsteinBasis(n, u, basis_.data());
+	for (int k = 0; k <= n; k++) {
+		for (int d = 0; d < DIM; d++) {
+			d_[k][d] += sign * basis_[k] * r[d];
+		}
+	}
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::rebuild() {
+	using namespace std;
+	fill(m_.begin(), m_.end(), 0.0);
+	fill(d_.begin(), d_.end(), Vec{});
+	dd_ = 0;
+	updates_ = 0;
+	rebuild_size_ = points_.size();
+	if (points_.empty()) {
+		return;
+	}
+	// u in [0, 1] over the window and the coordinates about its first
+	// data point
+	origin_ = arc_.front();
+	scale_ = arc_.back() - arc_.front();
+	if (!(scale_ > 0)) {
+		scale_ = 0;
+	}
+	centre_ = points_.front();
+	for (size_t k = 0; k < points_.size(); k++) {
+		accumulate(points_[k], arc_[k], 1);
+	}
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::countUpdate() {
+	// The window in u is [a, a + w]. Far from [0, 1], the change of
+	// interval of the moments amplifies their rounding; and every update
+	// adds some, which the retirements do not take back.
+	const double length = arc_.back() - arc_.front();
+	bool drifted = false;
+	if (scale_ > 0) {
+		const double a = (arc_.front() - origin_) / scale_;
+		const double b = (arc_.back() - origin_) / scale_;
+		drifted = std::fabs(a) > kMaxDrift || std::fabs(b - 1) > kMaxDrift;
+	} else {
+		drifted = length > 0;
+	}
+	if (drifted || ++updates_ > rebuild_size_) {
+		rebuild();
+	}
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::pushBack(const Vec& data_point) {
+	double arc = 0;
+	if (!points_.empty()) {
+		const Vec& last = points_.back();
+		double chord = 0;
+		for (int d = 0; d < DIM; d++) {
+			chord += (data_point[d] - last[d]) * (data_point[d] - last[d]);
+		}
+		arc = arc_.back() + std::sqrt(chord);
+	}
+	points_.push_back(data_point);
+	arc_.push_back(arc);
+	if (points_.size() == 1) {
+		rebuild();
+	} else {
+		accumulate(data_point, arc, 1);
+		countUpdate();
+	}
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::append(const Vec& data_point) {
+	pushBack(data_point);
+	updateNormalEquations();
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::append(const std::vector<Vec>& data_points) {
+	for (const Vec& p : data_points) {
+		pushBack(p);
+	}
+	updateNormalEquations();
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::retire(const size_t count) {
+	for (size_t k = 0; k < count && !points_.empty(); k++) {
+		accumulate(points_.front(), arc_.front(), -1);
+		points_.pop_front();
+		arc_.pop_front();
+		countUpdate();
+	}
+	if (points_.empty()) {
+		rebuild();
+	}
+	updateNormalEquations();
+}
+
+template <int DIM>
+size_t BezierStreamND<DIM>::size() const {
+	return points_.size();
+}
+
+template <int DIM>
+double BezierStreamND<DIM>::chordLength() const {
+	return points_.empty() ? 0 : arc_.back() - arc_.front();
+}
+
+template <int DIM>
+std::vector<typename BezierStreamND<DIM>::DataPoint>
+BezierStreamND<DIM>::dataPoints() const {
+	using namespace std;
+	const size_t count = points_.size();
+	const double length = chordLength();
+	vector<DataPoint> data(count);
+	for (size_t k = 0; k < count; k++) {
+		const double t = length > 0 ? (arc_[k] - arc_.front()) / length
+			: k / static_cast<double>(max<size_t>(1, count - 1));
+		data[k] = DataPoint{t, points_[k]};
+	}
+	return data;
+}
+
+template <int DIM>
+void BezierStreamND<DIM>::updateNormalEquations() {
+	const int n = kNumberControlPoints_ - 1;
+	const int cps = kNumberControlPoints_;
+	if (points_.empty()) {
+		std::fill(gram_.begin(), gram_.end(), 0.0);
+		std::fill(basis_dot_data_.begin(), basis_dot_data_.end(), Vec{});
+		return;
+	}
+	// The moments are sums of the Bernstein basis of u on [0, 1]; the
+	// window is [a, a + w] in u, and t = (u - a) / w. Coefficient k of
+	// b_m(t) in the basis of u is the blossom of b_m at (t(0) x N - k,
+	// t(1) x k), so
+	//   sum b_m(t) = sum_k blossom_m(t(0), t(1); k) sum b_k(u)
+	const int n2 = 2 * n;
+	double t0 = 0;
+	double t1 = 1;
+	if (scale_ > 0) {
+		const double a = (arc_.front() - origin_) / scale_;
+		const double w = chordLength() / scale_;
+		t0 = -a / w;
+		t1 = (1 - a) / w;
+	}
+	std::fill(t_moments_.begin(), t_moments_.end(), 0.0);
+	std::fill(s_moments_.begin(), s_moments_.end(), Vec{});
+	if (scale_ > 0) {
+		for (int k = 0; k <= n2; k++) {
+			bernsteinBlossom(n2, k, t0, t1, basis_.data());
+			for (int m = 0; m <= n2; m++) {
+				t_moments_[m] += basis_[m] * m_[k];
+			}
+		}
+		for (int k = 0; k <= n; k++) {
+			bernsteinBlossom(n, k, t0, t1, basis_.data());
+			for (int m = 0; m <= n; m++) {
+				for (int d = 0; d < DIM; d++) {
+					s_moments_[m][d] += basis_[m] * d_[k][d];
+				}
+			}
+		}
+	} else {
+		// a window of zero length: every data point at t = 0, as was u
+		t_moments_[0] = m_[0];
+		s_moments_[0] = d_[0];
+	}
+	// b^n_i b^n_j = C(n,i) C(n,j) / C(2n,i+j) b^2n_(i+j)
+	for (int i = 0; i <= n; i++) {
+		for (int j = 0; j <= i; j++) {
+			const double g = binomialCoefficient(n, i) * binomialCoefficient(n, j)
+				/ binomialCoefficient(n2, i + j) * t_moments_[i + j];
+			gram_[i * cps + j] = g;
+			gram_[j * cps + i] = g;
+		}
+		basis_dot_data_[i] = s_moments_[i];
+	}
+}
+
+template <int DIM>
+bool BezierStreamND<DIM>::solveControlPointsWithLeastSquares() {
+	if (points_.empty()) {
+		return false;
+	}
+	const int n = kNumberControlPoints_ - 1;
+	const int m = n - 1;
+	control_points_.front() = points_.front();
+	control_points_.back() = points_.back();
+	if (m <= 0) {
+		return true;
+	}
+	// As BezierCurveND, relative to centre_:
+	//   G_ff x = B_f^T d - G_f0 P_0 - G_fn P_n
+	Vec p0, pn;
+	for (int d = 0; d < DIM; d++) {
+		p0[d] = control_points_.front()[d] - centre_[d];
+		pn[d] = control_points_.back()[d] - centre_[d];
+	}
+	normal_matrix_.resize(m * m);
+	normal_rhs_.resize(m * DIM);
+	for (int i = 0; i < m; i++) {
+		const double* g = gram_.data() + (i + 1) * kNumberControlPoints_;
+		for (int j = 0; j < m; j++) {
+			normal_matrix_[i * m + j] = g[j + 1];
+		}
+		for (int d = 0; d < DIM; d++) {
+			normal_rhs_[i * DIM + d] = basis_dot_data_[i + 1][d]
+				- g[0] * p0[d] - g[n] * pn[d];
+		}
+	}
+	if (!choleskyFactor(normal_matrix_, m)) {
+		return false;
+	}
+	for (int d = 0; d < DIM; d++) {
+		choleskySubstitute(normal_matrix_, m, normal_rhs_.data() + d, DIM);
+	}
+	for (int i = 0; i < m; i++) {
+		for (int d = 0; d < DIM; d++) {
+			control_points_[i + 1][d] = normal_rhs_[i * DIM + d] + centre_[d];
+		}
+	}
+	return true;
+}
+
+template <int DIM>
+template <class CONTROL_POINT>
+double BezierStreamND<DIM>::errorOf(const CONTROL_POINT& control_point) const {
+	// sum |d - C|^2 = sum |d|^2 - 2 sum_i P_i.(B^T d)_i + sum_ij G_ij P_i.P_j
+	// with everything relative to centre_ (the basis sums to one)
+	const int cps = kNumberControlPoints_;
+	double error = dd_;
+	for (int i = 0; i < cps; i++) {
+		const Vec pi = control_point(i);
+		double quadratic = 0;
+		for (int j = 0; j < i; j++) {
+			const Vec pj = control_point(j);
+			double dot = 0;
+			for (int d = 0; d < DIM; d++) {
+				dot += (pi[d] - centre_[d]) * (pj[d] - centre_[d]);
+			}
+			quadratic += gram_[i * cps + j] * dot;
+		}
+		double norm = 0;
+		double linear = 0;
+		for (int d = 0; d < DIM; d++) {
+			const double r = pi[d] - centre_[d];
+			norm += r * r;
+			linear += r * basis_dot_data_[i][d];
+		}
+		error += 2 * quadratic + gram_[i * cps + i] * norm - 2 * linear;
+	}
+	return error > 0 ? error : 0;
+}
+
+template <int DIM>
+double BezierStreamND<DIM>::calcError() const {
+	return errorOf([this](const int i) {
+		return control_points_[i];
+	});
+}
+
+template <int DIM>
+double BezierStreamND<DIM>::calcErrorWithInnerControlPoints(const double* inner) const {
+	if (points_.empty()) {
+		return 0;
+	}
+	const int n = kNumberControlPoints_ - 1;
+	return errorOf([this, inner, n](const int i) {
+		if (i == 0 || i == n) {
+			return i == 0 ? points_.front() : points_.back();
+		}
+		Vec p;
+		for (int d = 0; d < DIM; d++) {
+			p[d] = inner[DIM * (i - 1) + d];
+		}
+		return p;
+	});
+}
+
+template struct BezierStreamND<2>;
+template struct BezierStreamND<3>;
@@ -0,0 +1,106 @@
+
+
+#ifndef BEZIERSTREAM_HPP_
+#define BEZIERSTREAM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <vector>
+
+#include "BezierCurve.hpp"
+
+// Least-squares bezier fit of a window of streamed data points, chord
+// length parameterized, with the end points pinned to the first and last
+// data points of the window.
+// Appending or retiring a data point changes the t-value of every other
+// one (t is the chord length over the window's length), so no basis is
+// cached: the window is summarized by moments of its chord length u,
+//   M_k = sum b^2n_k(u)    and    D_k = sum b^n_k(u) (x - centre)
+// (b the Bernstein basis, n = CP - 1), which a data point updates in
+// O(CP^2), and from which the normal equations of the current window
+// follow in O(CP^3), whatever its size. u is 0 and 1 at the ends of the
+// window when the moments are summed; they are summed again from the
+// window once its ends drift by a quarter of that or it has seen as many
+// updates as it had points, for O(CP^2) amortized per data point.
+// For Newton reparameterization, fit dataPoints() with a BezierCurveND.
+template <int DIM>
+struct BezierStreamND {
+
+	using Vec = VecNd<DIM>;
+	using DataPoint = std::tuple<double,Vec>;
+
+	const uint32_t kNumberControlPoints_;
+	std::vector<Vec> control_points_;
+
+
+	explicit BezierStreamND(const uint32_t control_points);
+
+	// One sqrt for its chord plus O(CP^2) per data point; each call then
+	// refreshes the normal equations in O(CP^3)
+	void append(const Vec& data_point);
+	void append(const std::vector<Vec>& data_points);
+	// Drops the `count` oldest data points, at the same costs
+	void retire(const size_t count);
+
+	size_t size() const;
+	// Chord length of the window
+	double chordLength() const;
+	// The window as chord length parameterized data points
+	std::vector<DataPoint> dataPoints() const;
+
+	// Sets the first and last control points to the first and last data
+	// points and the inner ones to the exact least-squares fit, O(CP^3).
+	// Returns false (inner control points untouched) when the system is
+	// singular, e.g. with fewer data points than control points.
+	bool solveControlPointsWithLeastSquares();
+	// Sum of the squared distances between the data points and the curve
+	// at their t-values, O(CP^2) from the moments. Expanding the square
+	// cancels about log10(spread / distance)^2 digits on close fits.
+	double calcError() const;
+	// calcError of the curve whose inner control point i (in [1, CP - 2])
+	// has coordinates inner[DIM * (i - 1) + d]. Thread safe.
+	double calcErrorWithInnerControlPoints(const double* inner) const;
+
+private:
+	std::deque<Vec> points_;
+	// chord length from the first data point ever appended
+	std::deque<double> arc_;
+
+	// u = (arc - origin_) / scale_ and the coordinates relative to centre_,
+	// as of the last rebuild; scale_ is 0 for a window of zero length
+	double origin_;
+	double scale_;
+	Vec centre_;
+	std::vector<double> m_;
+	std::vector<Vec> d_;
+	double dd_;
+	size_t updates_;
+	size_t rebuild_size_;
+
+	// Normal equations of the window, from the moments: gram_ = B^T B and
+	// basis_dot_data_ = B^T (d - centre_)
+	std::vector<double> gram_;
+	std::vector<Vec> basis_dot_data_;
+	// scratch of the normal equations
+	std::vector<double> t_moments_;
+	std::vector<Vec> s_moments_;
+	std::vector<double> basis_;
+	std::vector<double> normal_matrix_;
+	std::vector<double> normal_rhs_;
+
+	void accumulate(const Vec& data_point, const double arc, const double sign);
+	void rebuild();
+	void countUpdate();
+	void pushBack(const Vec& data_point);
+	void updateNormalEquations();
+	// calcError of the control points control_point(i), i in [0, CP)
+	template <class CONTROL_POINT>
+	double errorOf(const CONTROL_POINT& control_point) const;
+};
+
+using BezierStream = BezierStreamND<2>;
+using BezierStream3d = BezierStreamND<3>;
+
+#endif /* BEZIERSTREAM_HPP_ */
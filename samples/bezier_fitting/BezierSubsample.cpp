@@ -0,0 +1,224 @@
+
+#include "BezierSubsample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#include "pdebc/ThreadsDE.hpp"
+
+template <int DIM>
+ErrorSubsampleND<DIM>::ErrorSubsampleND(const BezierCurveND<DIM>& curve,
+	const uint64_t seed) :
+		curve_{curve}, engine_{seed}, size_{0}, weight_{1} {
+
+	draw(curve.kNumberDataPoints_);
+}
+
+template <int DIM>
+void ErrorSubsampleND<DIM>::draw(const size_t size) {
+	using namespace std;
+	const size_t count = curve_.kNumberDataPoints_;
+	if (size >= count) {
+		size_ = count;
+		weight_ = 1;
+		sample_.reset();
+		return;
+	}
+	// one point uniformly in each of the strata [s h, (s + 1) h): every
+	// data point is drawn with probability 1 / h, whatever h
+	const double h = count / static_cast<double>(size);
+	uniform_real_distribution<double> jitter(0.0, 1.0);
+	vector<typename BezierCurveND<DIM>::DataPoint> data_points(size);
+	for (size_t s = 0; s < size; s++) {
+		const size_t k = min(count - 1, static_cast<size_t>((s + jitter(engine_)) * h));
+		data_points[s] = typename BezierCurveND<DIM>::DataPoint{
+			curve_.getParameterization(k), curve_.getDataPoint(k)};
+	}
+	size_ = size;
+	weight_ = h;
+	sample_.reset(new BezierCurveND<DIM>(data_points, curve_.control_points_,
+		BasisStorage::Stored));
+	if (curve_.isRational()) {
+		sample_->setWeights(curve_.weights());
+	}
+}
+
+template <int DIM>
+size_t ErrorSubsampleND<DIM>::size() const {
+	return size_;
+}
+
+template <int DIM>
+bool ErrorSubsampleND<DIM>::exact() const {
+	return !sample_;
+}
+
+template <int DIM>
+double ErrorSubsampleND<DIM>::calcErrorWithInnerControlPoints(const double* inner) const {
+	if (!sample_) {
+		return curve_.calcErrorWithInnerControlPoints(inner);
+	}
+	return weight_ * sample_->calcErrorWithInnerControlPoints(inner);
+}
+
+template <int DIM>
+double ErrorSubsampleND<DIM>::squaredDistance(const std::vector<Vec>& control_points,
+	const double t, const Vec& data_point) {
+	// de Casteljau, on (w P, w) when rational
+	const std::vector<double>& weights = curve_.weights();
+	casteljau_.resize(control_points.size());
+	for (size_t i = 0; i < control_points.size(); i++) {
+		for (int d = 0; d < DIM; d++) {
+			casteljau_[i][d] = weights[i] * control_points[i][d];
+		}
+		casteljau_[i][DIM] = weights[i];
+	}
+	for (size_t r = control_points.size() - 1; r > 0; r--) {
+		for (size_t i = 0; i < r; i++) {
+			for (int d = 0; d <= DIM; d++) {
+				casteljau_[i][d] = (1 - t) * casteljau_[i][d] + t * casteljau_[i + 1][d];
+			}
+		}
+	}
+	double distance = 0;
+	for (int d = 0; d < DIM; d++) {
+		const double delta = data_point[d] - casteljau_[0][d] / casteljau_[0][DIM];
+		distance += delta * delta;
+	}
+	return distance;
+}
+
+template <int DIM>
+double ErrorSubsampleND<DIM>::calcErrorDifference(const double* a, const double* b,
+	double& standard_error) {
+	using namespace std;
+	if (!sample_) {
+		standard_error = 0;
+		return curve_.calcErrorWithInnerControlPoints(a)
+			- curve_.calcErrorWithInnerControlPoints(b);
+	}
+	control_points_a_ = curve_.control_points_;
+	control_points_b_ = curve_.control_points_;
+	for (size_t i = 1; i + 1 < control_points_a_.size(); i++) {
+		for (int d = 0; d < DIM; d++) {
+			control_points_a_[i][d] = a[DIM * (i - 1) + d];
+			control_points_b_[i][d] = b[DIM * (i - 1) + d];
+		}
+	}
+	// On data points drawn again: b is usually the best candidate of the
+	// subsample, and would look better on it than it is. The strata are
+	// treated as a simple random sample, an upper bound of the variance of
+	// the stratified estimate.
+	const size_t count = curve_.kNumberDataPoints_;
+	uniform_real_distribution<double> jitter(0.0, 1.0);
+	double sum = 0;
+	double sum_squares = 0;
+	for (size_t s = 0; s < size_; s++) {
+		const size_t k = min(count - 1, static_cast<size_t>((s + jitter(engine_)) * weight_));
+		const double t = curve_.getParameterization(k);
+		const Vec x = curve_.getDataPoint(k);
+		const double delta = squaredDistance(control_points_a_, t, x)
+			- squaredDistance(control_points_b_, t, x);
+		sum += delta;
+		sum_squares += delta * delta;
+	}
+	const double mean = sum / size_;
+	const double variance = size_ > 1
+		? max(0.0, (sum_squares - size_ * mean * mean) / (size_ - 1)) : 0;
+	standard_error = weight_ * sqrt(size_ * variance);
+	return weight_ * sum;
+}
+
+template <int DIM>
+SubsampledFit fitWithSubsampledDE(BezierCurveND<DIM>& curve,
+	const SubsampleOptions& options) {
+	using namespace std;
+	using JointThreadsDE = pdebc::ThreadsDE<double,pdebc::kDynamicDim,double>;
+	const int inner = curve.kNumberControlPoints_ - 2;
+	SubsampledFit fit;
+	if (inner < 1) {
+		fit.error_ = curve.calcError();
+		return fit;
+	}
+
+	// candidates are drawn around the data, whatever its units
+	double lower = curve.getDataPoint(0)[0];
+	double upper = lower;
+	for (uint32_t k = 0; k < curve.kNumberDataPoints_; k++) {
+		const VecNd<DIM> p = curve.getDataPoint(k);
+		for (int d = 0; d < DIM; d++) {
+			lower = min(lower, p[d]);
+			upper = max(upper, p[d]);
+		}
+	}
+	const double extent = max(upper - lower, 1e-9);
+	mt19937_64 seeds(options.seed);
+	mt19937_64 emt(seeds());
+	uniform_real_distribution<double> ud(lower - extent / 2, upper + extent / 2);
+
+	ErrorSubsampleND<DIM> subsample(curve, seeds());
+	JointThreadsDE de(DIM * inner, 8, 0.8, options.population_size, 0.5, 0.8,
+		bind(ud, emt),
+		[&subsample](const vector<double>& v) -> double {
+			return subsample.calcErrorWithInnerControlPoints(v.data());
+		},
+		[](const double& a, const double& b) {
+			return a < b;
+		}, seeds());
+
+	size_t size = options.initial_size;
+	// best candidate when the progress was last significant
+	vector<double> anchor;
+	int stalled = 0;
+	for (int g = 0; g < options.generations; g++) {
+		if (g == 0 || !subsample.exact()) {
+			// a new subsample, on which the whole population is judged again
+			subsample.draw(size);
+			de.reevaluatePopulation();
+		}
+		fit.sample_sizes_.push_back(subsample.size());
+		if (subsample.exact()) {
+			de.solveOneGeneration();
+			continue;
+		}
+		if (anchor.empty()) {
+			anchor = get<1>(de.getBestCandidate());
+		}
+		de.solveOneGeneration();
+		const vector<double> best = get<1>(de.getBestCandidate());
+		double standard_error;
+		const double progress = subsample.calcErrorDifference(anchor.data(),
+			best.data(), standard_error);
+		if (progress > options.z * standard_error) {
+			anchor = best;
+			stalled = 0;
+		} else if (++stalled >= options.patience) {
+			size *= 2;
+			anchor.clear();
+			stalled = 0;
+		}
+	}
+	if (!subsample.exact()) {
+		subsample.draw(curve.kNumberDataPoints_);
+		de.reevaluatePopulation();
+	}
+
+	const vector<double> best = get<1>(de.getBestCandidate());
+	for (int i = 0; i < inner; i++) {
+		for (int d = 0; d < DIM; d++) {
+			curve.control_points_[i + 1][d] = best[DIM * i + d];
+		}
+	}
+	fit.error_ = curve.calcError();
+	return fit;
+}
+
+template struct ErrorSubsampleND<2>;
+template struct ErrorSubsampleND<3>;
+template SubsampledFit fitWithSubsampledDE(BezierCurveND<2>& curve,
+	const SubsampleOptions& options);
+template SubsampledFit fitWithSubsampledDE(BezierCurveND<3>& curve,
+	const SubsampleOptions& options);
@@ -0,0 +1,96 @@
+
+
+#ifndef BEZIERSUBSAMPLE_HPP_
+#define BEZIERSUBSAMPLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "BezierCurve.hpp"
+
+// Unbiased estimate of the error of a BezierCurveND from a stratified
+// subsample of its data points: the data points are cut into `size`
+// strata of DP / size points, one point is drawn uniformly in each and
+// stands for DP / size of them. The subsample is a small BezierCurveND of
+// its own, so an estimate costs O(size CP) instead of O(DP CP). The
+// subsample takes the weights of a rational curve.
+template <int DIM>
+struct ErrorSubsampleND {
+
+	using Vec = VecNd<DIM>;
+
+	// curve must outlive the subsample and keep its data points; its
+	// first and last control points are the pinned ones
+	ErrorSubsampleND(const BezierCurveND<DIM>& curve, const uint64_t seed);
+
+	// Draws a new subsample of `size` data points. From size >= DP on, all
+	// of them are taken: the estimates are then the curve's exact errors.
+	void draw(const size_t size);
+	size_t size() const;
+	bool exact() const;
+
+	// Estimate of curve.calcErrorWithInnerControlPoints(inner). Thread
+	// safe between draws.
+	double calcErrorWithInnerControlPoints(const double* inner) const;
+	// Estimate of the error of the inner control points `a` minus the
+	// error of `b`, and its standard error (0 once exact), on a new draw
+	// of size() data points. Both are judged on the same data points, so
+	// most of the sampling noise cancels. O(size CP^2).
+	double calcErrorDifference(const double* a, const double* b,
+		double& standard_error);
+
+private:
+	const BezierCurveND<DIM>& curve_;
+	std::mt19937_64 engine_;
+	size_t size_;
+	// data points each subsampled one stands for
+	double weight_;
+	// null once exact
+	std::unique_ptr<BezierCurveND<DIM>> sample_;
+	// scratch of calcErrorDifference
+	std::vector<Vec> control_points_a_;
+	std::vector<Vec> control_points_b_;
+	// homogeneous, the weight last
+	std::vector<VecNd<DIM + 1>> casteljau_;
+
+	double squaredDistance(const std::vector<Vec>& control_points,
+		const double t, const Vec& data_point);
+};
+
+using ErrorSubsample = ErrorSubsampleND<2>;
+using ErrorSubsample3d = ErrorSubsampleND<3>;
+
+struct SubsampleOptions {
+	// data points of the first subsample
+	size_t initial_size{1024};
+	// The subsample doubles once the best candidate has not improved by
+	// more than z standard errors for `patience` generations in a row:
+	// the DE can no longer tell its selections from the sampling noise.
+	double z{2};
+	int patience{5};
+	int generations{100};
+	int population_size{128};
+	uint64_t seed{42};
+};
+
+struct SubsampledFit {
+	// calcError of the best candidate, always exact
+	double error_;
+	// subsample size of each generation, DP for the exact ones
+	std::vector<size_t> sample_sizes_;
+};
+
+// One DE over every inner control point (kDynamicDim), whose errors are
+// estimated on a new subsample each generation. The population is judged
+// again on each subsample before the generation runs, so a trial and its
+// target are always compared on the same data points. The last selection
+// is exact whatever the subsample reached. Sets curve.control_points_ to
+// the best candidate.
+template <int DIM>
+SubsampledFit fitWithSubsampledDE(BezierCurveND<DIM>& curve,
+	const SubsampleOptions& options);
+
+#endif /* BEZIERSUBSAMPLE_HPP_ */
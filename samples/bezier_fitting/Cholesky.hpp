@@ -0,0 +1,52 @@
+
+
+#ifndef CHOLESKY_HPP_
+#define CHOLESKY_HPP_
+
+#include <cmath>
+#include <vector>
+
+// In-place Cholesky factorization a = L L^T of an m x m matrix,
+// false when it is not positive definite
+inline bool choleskyFactor(std::vector<double>& a, const int m) {
+	for (int j = 0; j < m; j++) {
+		double diag = a[j * m + j];
+		for (int k = 0; k < j; k++) {
+			diag -= a[j * m + k] * a[j * m + k];
+		}
+		if (!(diag > 0)) {
+			return false;
+		}
+		diag = std::sqrt(diag);
+		a[j * m + j] = diag;
+		for (int i = j + 1; i < m; i++) {
+			double v = a[i * m + j];
+			for (int k = 0; k < j; k++) {
+				v -= a[i * m + k] * a[j * m + k];
+			}
+			a[i * m + j] = v / diag;
+		}
+	}
+	return true;
+}
+
+// Solves L L^T x = b in place, x[i * stride] holding b on entry
+inline void choleskySubstitute(const std::vector<double>& l, const int m,
+	double* x, const int stride) {
+	for (int i = 0; i < m; i++) {
+		double v = x[i * stride];
+		for (int k = 0; k < i; k++) {
+			v -= l[i * m + k] * x[k * stride];
+		}
+		x[i * stride] = v / l[i * m + i];
+	}
+	for (int i = m - 1; i >= 0; i--) {
+		double v = x[i * stride];
+		for (int k = i + 1; k < m; k++) {
+			v -= l[k * m + i] * x[k * stride];
+		}
+		x[i * stride] = v / l[i * m + i];
+	}
+}
+
+#endif /* CHOLESKY_HPP_ */
@@ -0,0 +1,127 @@
+
+
+#ifndef PARALLELFOR_HPP_
+#define PARALLELFOR_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#include "pdebc/ThreadPool.hpp"
+
+static constexpr std::size_t kMaxParallelRanges{64};
+
+// Runs body(i) for every i in [0, count) on `pool`. The indices are split
+// into contiguous ranges, one per pool thread plus one run by the calling
+// thread, which then helps the pool until every range is done.
+// Nothing is allocated: the tasks live on the caller's stack.
+template <class BODY>
+void parallelFor(pdebc::ThreadPool& pool, const std::size_t count,
+	const BODY& body) {
+	struct RangeTask : pdebc::ThreadPool::Task {
+		const BODY* body;
+		std::size_t begin;
+		std::size_t end;
+		std::atomic<std::size_t>* pending;
+
+		void execute() override {
+			for (std::size_t i = begin; i < end; ++i) {
+				(*body)(i);
+			}
+			pending->fetch_sub(1, std::memory_order_release);
+		}
+	};
+
+	std::size_t n_ranges = pool.size() + 1;
+	n_ranges = n_ranges < count ? n_ranges : count;
+	n_ranges = n_ranges < kMaxParallelRanges ? n_ranges : kMaxParallelRanges;
+	if (n_ranges <= 1) {
+		for (std::size_t i = 0; i < count; ++i) {
+			body(i);
+		}
+		return;
+	}
+
+	RangeTask ranges[kMaxParallelRanges];
+	std::atomic<std::size_t> pending{n_ranges};
+	for (std::size_t r = 0; r < n_ranges; ++r) {
+		ranges[r].body = &body;
+		ranges[r].begin = count * r / n_ranges;
+		ranges[r].end = count * (r + 1) / n_ranges;
+		ranges[r].pending = &pending;
+	}
+	for (std::size_t r = 1; r < n_ranges; ++r) {
+		pool.submit(&ranges[r]);
+	}
+	ranges[0].execute();
+	while (pending.load(std::memory_order_acquire) > 0) {
+		if (!pool.runPendingTask()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+// Number of workers parallelForDynamic runs count indices on
+inline std::size_t parallelWorkers(pdebc::ThreadPool& pool,
+	const std::size_t count) {
+	std::size_t n_workers = pool.size() + 1;
+	n_workers = n_workers < count ? n_workers : count;
+	return n_workers < kMaxParallelRanges ? n_workers : kMaxParallelRanges;
+}
+
+// Runs body(worker, i) for every i in [0, count) on `pool`. Unlike
+// parallelFor the indices are handed out one at a time, so uneven pieces
+// of work balance out. worker, in [0, parallelWorkers(pool, count)),
+// runs one body at a time: callers can keep per-worker buffers.
+template <class BODY>
+void parallelForDynamic(pdebc::ThreadPool& pool, const std::size_t count,
+	const BODY& body) {
+	struct WorkerTask : pdebc::ThreadPool::Task {
+		const BODY* body;
+		std::size_t worker;
+		std::size_t count;
+		std::atomic<std::size_t>* next;
+		std::atomic<std::size_t>* pending;
+
+		void execute() override {
+			for (;;) {
+				const std::size_t i = next->fetch_add(1, std::memory_order_relaxed);
+				if (i >= count) {
+					break;
+				}
+				(*body)(worker, i);
+			}
+			pending->fetch_sub(1, std::memory_order_release);
+		}
+	};
+
+	const std::size_t n_workers = parallelWorkers(pool, count);
+	if (n_workers <= 1) {
+		for (std::size_t i = 0; i < count; ++i) {
+			body(0, i);
+		}
+		return;
+	}
+
+	WorkerTask workers[kMaxParallelRanges];
+	std::atomic<std::size_t> next{0};
+	std::atomic<std::size_t> pending{n_workers};
+	for (std::size_t w = 0; w < n_workers; ++w) {
+		workers[w].body = &body;
+		workers[w].worker = w;
+		workers[w].count = count;
+		workers[w].next = &next;
+		workers[w].pending = &pending;
+	}
+	for (std::size_t w = 1; w < n_workers; ++w) {
+		pool.submit(&workers[w]);
+	}
+	workers[0].execute();
+	while (pending.load(std::memory_order_acquire) > 0) {
+		if (!pool.runPendingTask()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+#endif /* PARALLELFOR_HPP_ */
@@ -0,0 +1,204 @@
+
+#include "PolylineSimplify.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "ParallelFor.hpp"
+
+namespace {
+
+// Squared distance from p to the segment [a, b]
+double segmentDistance2(const Vec2d& p, const Vec2d& a, const Vec2d& b) {
+	const double ux = b[0] - a[0], uy = b[1] - a[1];
+	const double wx = p[0] - a[0], wy = p[1] - a[1];
+	const double l2 = ux * ux + uy * uy;
+	double s = l2 > 0 ? (wx * ux + wy * uy) / l2 : 0;
+	s = s < 0 ? 0 : (s > 1 ? 1 : s);
+	const double dx = wx - s * ux, dy = wy - s * uy;
+	return dx * dx + dy * dy;
+}
+
+double triangleArea(const Vec2d& a, const Vec2d& b, const Vec2d& c) {
+	return 0.5 * std::fabs((b[0] - a[0]) * (c[1] - a[1])
+		- (b[1] - a[1]) * (c[0] - a[0]));
+}
+
+} // namespace
+
+std::vector<uint32_t> simplifyDouglasPeucker(const std::vector<Vec2d>& points,
+	const uint32_t begin, const uint32_t end, const double tolerance) {
+	using namespace std;
+	const double tolerance2 = tolerance * tolerance;
+	vector<char> keep(end - begin + 1, 0);
+	keep.front() = 1;
+	keep.back() = 1;
+	// explicit stack: scanner polylines are deep enough to overflow recursion
+	vector<pair<uint32_t,uint32_t>> stack{{begin, end}};
+	while (!stack.empty()) {
+		const uint32_t a = stack.back().first;
+		const uint32_t b = stack.back().second;
+		stack.pop_back();
+		double farthest = 0;
+		uint32_t index = a;
+		for (uint32_t k = a + 1; k < b; k++) {
+			const double d = segmentDistance2(points[k], points[a], points[b]);
+			if (d > farthest) {
+				farthest = d;
+				index = k;
+			}
+		}
+		if (farthest > tolerance2) {
+			keep[index - begin] = 1;
+			stack.push_back({a, index});
+			stack.push_back({index, b});
+		}
+	}
+	vector<uint32_t> kept;
+	for (uint32_t k = begin; k <= end; k++) {
+		if (keep[k - begin]) {
+			kept.push_back(k);
+		}
+	}
+	return kept;
+}
+
+std::vector<uint32_t> simplifyVisvalingam(const std::vector<Vec2d>& points,
+	const uint32_t begin, const uint32_t end, const double tolerance) {
+	using namespace std;
+	const uint32_t m = end - begin + 1;
+	const double threshold = tolerance * tolerance;
+	// doubly linked list of the remaining points, local indices
+	vector<uint32_t> prev(m);
+	vector<uint32_t> next(m);
+	vector<double> area(m, 0.0);
+	vector<char> removed(m, 0);
+	using Entry = pair<double,uint32_t>;
+	priority_queue<Entry, vector<Entry>, greater<Entry>> heap;
+	for (uint32_t i = 0; i < m; i++) {
+		prev[i] = i - 1;
+		next[i] = i + 1;
+	}
+	for (uint32_t i = 1; i + 1 < m; i++) {
+		area[i] = triangleArea(points[begin + i - 1], points[begin + i],
+			points[begin + i + 1]);
+		heap.push({area[i], i});
+	}
+	while (!heap.empty()) {
+		const Entry top = heap.top();
+		heap.pop();
+		const uint32_t i = top.second;
+		// stale entry of a point removed or updated since it was pushed
+		if (removed[i] || top.first != area[i]) {
+			continue;
+		}
+		if (top.first >= threshold) {
+			break;
+		}
+		removed[i] = 1;
+		const uint32_t a = prev[i];
+		const uint32_t b = next[i];
+		next[a] = b;
+		prev[b] = a;
+		// a neighbour never gets a smaller area than the point just
+		// removed, so points go in order of their effective area
+		for (const uint32_t j : {a, b}) {
+			if (j == 0 || j == m - 1) {
+				continue;
+			}
+			const double e = triangleArea(points[begin + prev[j]], points[begin + j],
+				points[begin + next[j]]);
+			area[j] = max(e, top.first);
+			heap.push({area[j], j});
+		}
+	}
+	vector<uint32_t> kept;
+	for (uint32_t i = 0; i < m; i++) {
+		if (!removed[i]) {
+			kept.push_back(begin + i);
+		}
+	}
+	return kept;
+}
+
+std::vector<uint32_t> decimatePolyline(const std::vector<Vec2d>& points,
+	const DecimationOptions& options, pdebc::ThreadPool& pool) {
+	using namespace std;
+	const uint32_t n = points.size();
+	if (n < 3) {
+		vector<uint32_t> all(n);
+		for (uint32_t k = 0; k < n; k++) {
+			all[k] = k;
+		}
+		return all;
+	}
+	const uint32_t chunk = max<uint32_t>(2, options.chunk_points);
+	const uint32_t n_chunks = (n - 1 + chunk - 1) / chunk;
+	vector<vector<uint32_t>> pieces(n_chunks);
+	parallelFor(pool, n_chunks, [&](const size_t c) {
+		const uint32_t begin = c * chunk;
+		const uint32_t end = min<uint32_t>(begin + chunk, n - 1);
+		pieces[c] = options.method == SimplifyMethod::DouglasPeucker
+			? simplifyDouglasPeucker(points, begin, end, options.tolerance)
+			: simplifyVisvalingam(points, begin, end, options.tolerance);
+	});
+	// consecutive pieces share their cut point
+	vector<uint32_t> kept{0};
+	for (const auto& piece : pieces) {
+		kept.insert(kept.end(), piece.begin() + 1, piece.end());
+	}
+	return kept;
+}
+
+DecimatedFit fitDecimated(const std::vector<Vec2d>& points,
+	const int control_points, const DecimationOptions& options,
+	const int iterations, const int newton_steps, const int refine_iterations,
+	pdebc::ThreadPool& pool) {
+	using namespace std;
+	DecimatedFit fit;
+	const uint32_t n = points.size();
+	fit.kept_ = decimatePolyline(points, options, pool);
+
+	// chord length parameterization of the full polyline, so the reduced
+	// fit starts where the full one would
+	vector<double> length(n, 0.0);
+	for (uint32_t k = 1; k < n; k++) {
+		length[k] = length[k - 1] + hypot(points[k][0] - points[k - 1][0],
+			points[k][1] - points[k - 1][1]);
+	}
+	const double total = n > 0 && length.back() > 0 ? length.back() : 1;
+	vector<tuple<double,Vec2d>> reduced_data;
+	reduced_data.reserve(fit.kept_.size());
+	for (const uint32_t k : fit.kept_) {
+		reduced_data.push_back(tuple<double,Vec2d>{length[k] / total, points[k]});
+	}
+	vector<Vec2d> initial(control_points);
+	for (int i = 0; i < control_points; i++) {
+		const double a = i / static_cast<double>(max(1, control_points - 1));
+		initial[i][0] = (1 - a) * points.front()[0] + a * points.back()[0];
+		initial[i][1] = (1 - a) * points.front()[1] + a * points.back()[1];
+	}
+	BezierCurve reduced{reduced_data, initial};
+	fit.reduced_error_ = reduced.fitWithLeastSquares(iterations);
+
+	// Verify on every point: project them on the reduced fit first
+	vector<tuple<double,Vec2d>> full_data(n);
+	for (uint32_t k = 0; k < n; k++) {
+		full_data[k] = tuple<double,Vec2d>{length[k] / total, points[k]};
+	}
+	BezierCurve full{full_data, reduced.control_points_};
+	for (int i = 0; i < newton_steps; i++) {
+		full.reparameterizeWithNewton();
+	}
+	fit.full_error_ = refine_iterations > 0
+		? full.fitWithLeastSquares(refine_iterations) : full.calcError();
+	uint32_t worst;
+	fit.full_max_error_ = sqrt(full.calcMaxError(worst));
+	fit.control_points_ = full.control_points_;
+	return fit;
+}
@@ -0,0 +1,56 @@
+
+
+#ifndef POLYLINESIMPLIFY_HPP_
+#define POLYLINESIMPLIFY_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "pdebc/ThreadPool.hpp"
+
+#include "BezierCurve.hpp"
+
+enum class SimplifyMethod {
+	// keeps the farthest point from the chord until all are within tolerance
+	DouglasPeucker,
+	// drops the point of smallest triangle area until all are above tolerance^2
+	Visvalingam
+};
+
+struct DecimationOptions {
+	SimplifyMethod method{SimplifyMethod::DouglasPeucker};
+	double tolerance{0.01};
+	// the polyline is cut in pieces of this many points, simplified in
+	// parallel; the cut points are always kept
+	uint32_t chunk_points{65536};
+};
+
+// Indices of the points kept, increasing, always with the first and last
+std::vector<uint32_t> simplifyDouglasPeucker(const std::vector<Vec2d>& points,
+	const uint32_t begin, const uint32_t end, const double tolerance);
+std::vector<uint32_t> simplifyVisvalingam(const std::vector<Vec2d>& points,
+	const uint32_t begin, const uint32_t end, const double tolerance);
+std::vector<uint32_t> decimatePolyline(const std::vector<Vec2d>& points,
+	const DecimationOptions& options,
+	pdebc::ThreadPool& pool = pdebc::ThreadPool::shared());
+
+struct DecimatedFit {
+	std::vector<uint32_t> kept_;
+	std::vector<Vec2d> control_points_;
+	// calcError over the decimated points, and over every point
+	double reduced_error_;
+	double full_error_;
+	// largest distance between a point and the curve, over every point
+	double full_max_error_;
+};
+
+// Least-squares fit on the decimated points, with the chord length
+// parameterization of the full polyline, then verified on every point
+// (after `newton_steps` reparameterization steps) and refined there by
+// `refine_iterations` least-squares rounds (0: verify only).
+DecimatedFit fitDecimated(const std::vector<Vec2d>& points,
+	const int control_points, const DecimationOptions& options,
+	const int iterations, const int newton_steps, const int refine_iterations,
+	pdebc::ThreadPool& pool = pdebc::ThreadPool::shared());
+
+#endif /* POLYLINESIMPLIFY_HPP_ */
@@ -0,0 +1,85 @@
+
+
+#ifndef SUMMATION_HPP_
+#define SUMMATION_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Pairwise summation of a stream of values in O(log n) memory: the value
+// added i-th is combined like the leaves of a balanced binary tree, so the
+// rounding error grows with log(n) instead of n.
+struct PairwiseAccumulator {
+	PairwiseAccumulator() : count_{0} {
+	}
+
+	void add(double v) {
+		int level = 0;
+		// like incrementing a binary counter, every carry merges two subtrees
+		for (uint64_t c = count_; c & 1; c >>= 1) {
+			v += levels_[level++];
+		}
+		levels_[level] = v;
+		++count_;
+	}
+
+	double result() const {
+		double s = 0;
+		int level = 0;
+		for (uint64_t c = count_; c; c >>= 1, ++level) {
+			if (c & 1) {
+				s += levels_[level];
+			}
+		}
+		return s;
+	}
+
+private:
+	std::array<double, 64> levels_;
+	uint64_t count_;
+};
+
+static constexpr std::size_t kSumLanes{8};
+static constexpr std::size_t kSumBlock{256};
+
+// Sum of term(i) for i in [begin, end), end - begin <= kSumBlock, in
+// kSumLanes independent lanes, which the compiler can map to SIMD
+// registers without reassociating. One block of blockedSum.
+template <class TERM>
+inline double laneSum(const std::size_t begin, const std::size_t end,
+	const TERM& term) {
+	double lanes[kSumLanes] = {};
+	std::size_t i = begin;
+	for (; i + kSumLanes <= end; i += kSumLanes) {
+		for (std::size_t l = 0; l < kSumLanes; ++l) {
+			lanes[l] += term(i + l);
+		}
+	}
+	for (; i < end; ++i) {
+		lanes[0] += term(i);
+	}
+	// pairwise over the lanes too
+	for (std::size_t w = kSumLanes / 2; w > 0; w /= 2) {
+		for (std::size_t l = 0; l < w; ++l) {
+			lanes[l] += lanes[l + w];
+		}
+	}
+	return lanes[0];
+}
+
+// Accurate and vectorizable sum of term(i) for i in [begin, end).
+// Blocks of kSumBlock terms are summed with laneSum and the block sums
+// are combined with a PairwiseAccumulator.
+template <class TERM>
+inline double blockedSum(const std::size_t begin, const std::size_t end,
+	const TERM& term) {
+	PairwiseAccumulator total;
+	for (std::size_t b = begin; b < end; b += kSumBlock) {
+		const std::size_t e = b + kSumBlock < end ? b + kSumBlock : end;
+		total.add(laneSum(b, e, term));
+	}
+	return total.result();
+}
+
+#endif /* SUMMATION_HPP_ */
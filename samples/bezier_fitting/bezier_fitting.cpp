@@ -22,16 +22,26 @@ Bezier Fitting Sample
 */
 
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <string>
 #include <random>
 #include <array>
 #include <tuple>
 #include <cmath>
 #include <vector>
+#include <memory>
 
 #include "pdebc/ThreadsDE.hpp"
 
 #include "BezierCurve.hpp"
+#include "BezierDegree.hpp"
+#include "PolylineSimplify.hpp"
+#include "BezierSpline.hpp"
+#include "BezierBatch.hpp"
+#include "BezierStream.hpp"
+#include "BezierSubsample.hpp"
 /*
 Aux function to calculate the parameterization values
 of the Bezier Curve using the Chord Length method
@@ -41,35 +51,61 @@ std::vector<double> calcChordLength(const std::vector<Vec2d>& data_points) {
 	const int DP = data_points.size();
 	vector<double> chord_length(DP);
 	chord_length[0] = 0;
-	chord_length[DP - 1] = 1;
-
-	double td = 0;
 
+	// one sqrt per chord: the running sums are normalized afterwards
 	for (int i = 1; i < DP; i++) {
 		const double vdx = data_points[i][0] - data_points[i - 1][0];
 		const double vdy = data_points[i][1] - data_points[i - 1][1];
-		const double d = sqrt(vdx * vdx + vdy * vdy);
-		td += d;
+		chord_length[i] = chord_length[i - 1] + sqrt(vdx * vdx + vdy * vdy);
 	}
-
-	double p_td = 0;
+	const double td = chord_length[DP - 1];
 	for (int i = 1; i < DP; i++) {
-		const double vdx = data_points[i][0] - data_points[i - 1][0];
-		const double vdy = data_points[i][1] - data_points[i - 1][1];
-		const double d = sqrt(vdx * vdx + vdy * vdy);
-		p_td += d;
-		chord_length[i] = p_td / td;
+		chord_length[i] /= td;
 	}
+	chord_length[DP - 1] = 1;
 	return chord_length;
 }
 
 
 constexpr int POPULATION_SIZE {128};
-constexpr int POPULATION_DIM {2};
+// one DE searches one control point, so it has the curve's dimension
+constexpr int POPULATION_DIM {BezierCurve::kDimensions};
 using POPULATION_TYPE = double;
 using ERROR_TYPE = double;
 constexpr double DOMAIN_LIMITS = 128;
 
+/*
+One DE per inner control point, searched in turn against the optimization
+cache; the DE dimension is the dimension of the curve
+*/
+template <int DIM>
+void solveControlPointsWithDE(BezierCurveND<DIM>& curve, const int generations) {
+	using namespace std;
+	using CurveThreadsDE = pdebc::ThreadsDE<POPULATION_TYPE,DIM,ERROR_TYPE>;
+	vector<unique_ptr<CurveThreadsDE>> des;
+	const int inner_cps = curve.control_points_.size() - 2;
+	for (int i = 0; i < inner_cps; i++) {
+		random_device rd;
+		mt19937 emt(rd());
+		uniform_real_distribution<POPULATION_TYPE> ud(-DOMAIN_LIMITS, +DOMAIN_LIMITS);
+		des.emplace_back(new CurveThreadsDE(8, 0.8, POPULATION_SIZE, 0.5, 0.8,
+			bind(ud, emt),
+			[&curve](const array<POPULATION_TYPE,DIM>& cp) -> ERROR_TYPE {
+				return curve.calcErrorWithOptimizationCache(cp);
+			},
+			[](const ERROR_TYPE& a, const ERROR_TYPE& b) {
+				return a < b;
+			}));
+	}
+	for (int g = 0; g < generations; g++) {
+		for (int i = 0; i < inner_cps; i++) {
+			curve.updateVariableCPForOptimizationCache(i + 1);
+			des[i]->solveOneGeneration();
+			curve.control_points_[i + 1] = get<1>(des[i]->getBestCandidate());
+		}
+	}
+}
+
 
 int main(int argc, char *argv[]) {
 	using namespace std;
@@ -102,20 +138,526 @@ int main(int argc, char *argv[]) {
 		= data_points_2dpos[data_points_2dpos.size()-1];
 	
 
+	/* with --least-squares the control points are solved exactly instead */
+	// and the parameterization values are improved with Newton steps
+	if (argc > 1 && string(argv[1]) == "--least-squares") {
+		for (int i = 0; i < 10; i++) {
+			const double error = bezier_curve.fitWithLeastSquares(1);
+			printf("Iteration %d error: %g\n", i, std::sqrt(error));
+		}
+		for (const auto& cp : bezier_curve.control_points_) {
+			printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+		}
+		return 0;
+	}
+
+	/* with --3d the same fit runs on a 3D trajectory */
+	// a cubic helix-like path; each DE now searches 3 coordinates
+	if (argc > 1 && string(argv[1]) == "--3d") {
+		const vector<Vec3d> cubic{{{-10,0,0}}, {{0,10,20}}, {{10,-10,20}}, {{20,0,0}}};
+		const int n = 50;
+		vector<tuple<double,Vec3d>> samples(n);
+		for (int k = 0; k < n; k++) {
+			const double t = k / (n - 1.0);
+			const double s = 1 - t;
+			Vec3d p;
+			for (int d = 0; d < 3; d++) {
+				p[d] = s * s * s * cubic[0][d] + 3 * s * s * t * cubic[1][d]
+					+ 3 * s * t * t * cubic[2][d] + t * t * t * cubic[3][d];
+			}
+			samples[k] = tuple<double,Vec3d>{t, p};
+		}
+		vector<Vec3d> control_points(4);
+		control_points.front() = cubic.front();
+		control_points.back() = cubic.back();
+		BezierCurve3d curve{samples, control_points};
+		solveControlPointsWithDE(curve, 100);
+		printf("DE error: %g\n", std::sqrt(curve.calcError()));
+		printf("Levenberg-Marquardt polish error: %g\n",
+			std::sqrt(curve.polishWithLevenbergMarquardt(20)));
+		for (const auto& cp : curve.control_points_) {
+			printf("Control-point: (%g,%g,%g)\n", cp[0], cp[1], cp[2]);
+		}
+		return 0;
+	}
+
+	/* with --select-degree the number of control points is not guessed */
+	// every count from 2 to 10 is fitted to a noisy cubic, BIC picks one
+	if (argc > 1 && string(argv[1]) == "--select-degree") {
+		const vector<Vec2d> cubic{{{-10,0}}, {{0,20}}, {{20,-20}}, {{30,0}}};
+		const int n = 20000;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.05);
+		vector<Vec2d> samples(n);
+		for (int k = 0; k < n; k++) {
+			const double t = k / (n - 1.0);
+			const double s = 1 - t;
+			for (int d = 0; d < 2; d++) {
+				samples[k][d] = s * s * s * cubic[0][d] + 3 * s * s * t * cubic[1][d]
+					+ 3 * s * t * t * cubic[2][d] + t * t * t * cubic[3][d];
+				if (k > 0 && k < n - 1) {
+					samples[k][d] += noise(emt);
+				}
+			}
+		}
+		DegreeSelectionOptions options;
+		const auto start = chrono::steady_clock::now();
+		const DegreeSelection selection = selectBezierDegree(samples, options);
+		const double seconds = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		for (size_t c = 0; c < selection.scores_.size(); c++) {
+			printf("Control-points %zu: error %g BIC %g\n",
+				c + options.min_control_points,
+				std::sqrt(selection.errors_[c] / n), selection.scores_[c]);
+		}
+		printf("Selected %d control-points (%.3f s)\n",
+			selection.control_points_, seconds);
+		for (const auto& cp : selection.best_) {
+			printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+		}
+		return 0;
+	}
+
+	/* with --decimate a densely oversampled cubic is simplified first */
+	// the fit runs on the few points Douglas-Peucker keeps, then is
+	// verified and refined on all of them
+	if (argc > 1 && string(argv[1]) == "--decimate") {
+		const vector<Vec2d> cubic{{{-10,0}}, {{0,20}}, {{20,-20}}, {{30,0}}};
+		const int n = 1000000;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.0005);
+		vector<Vec2d> samples(n);
+		for (int k = 0; k < n; k++) {
+			const double t = k / (n - 1.0);
+			const double s = 1 - t;
+			for (int d = 0; d < 2; d++) {
+				samples[k][d] = s * s * s * cubic[0][d] + 3 * s * s * t * cubic[1][d]
+					+ 3 * s * t * t * cubic[2][d] + t * t * t * cubic[3][d];
+				if (k > 0 && k < n - 1) {
+					samples[k][d] += noise(emt);
+				}
+			}
+		}
+		DecimationOptions options;
+		options.tolerance = 0.01;
+		const auto start = chrono::steady_clock::now();
+		const DecimatedFit fit = fitDecimated(samples, 4, options, 16, 2, 2);
+		const double seconds = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		printf("Kept %zu of %d data points (%.3f s)\n", fit.kept_.size(), n, seconds);
+		printf("Error on the kept points: %g, on all of them: %g (max %g)\n",
+			std::sqrt(fit.reduced_error_ / fit.kept_.size()),
+			std::sqrt(fit.full_error_ / n), fit.full_max_error_);
+		for (const auto& cp : fit.control_points_) {
+			printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+		}
+		return 0;
+	}
+
+	/* with --spline a long contour is fitted by a piecewise cubic curve */
+	// the square has three corners and a wavy top, sampled 100000 times
+	if (argc > 1 && string(argv[1]) == "--spline") {
+		const int n = 100000;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.002);
+		vector<Vec2d> contour(n);
+		for (int i = 0; i < n; i++) {
+			const double s = 4.0 * i / n;
+			if (s < 1) {
+				contour[i] = Vec2d{{s, 0}};
+			} else if (s < 2) {
+				contour[i] = Vec2d{{1, s - 1}};
+			} else if (s < 3) {
+				contour[i] = Vec2d{{3 - s, 1 + 0.1 * std::sin(12 * (s - 2))}};
+			} else {
+				contour[i] = Vec2d{{0, 4 - s}};
+			}
+			contour[i][0] += noise(emt);
+			contour[i][1] += noise(emt);
+		}
+		SplineFitOptions options;
+		options.tolerance = 0.02;
+		options.window = 2000;
+		// the top starts with a slope of 1.2: its corner turns by 0.69
+		options.corner_angle = 0.5;
+		const auto start = chrono::steady_clock::now();
+		const BezierSpline spline = fitBezierSpline(contour, options);
+		const double seconds = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		printf("Segments: %zu corners: %zu max error: %g (%.3f s)\n",
+			spline.segments_.size(), spline.corners_.size(),
+			spline.max_error_, seconds);
+		for (size_t s = 0; s < spline.segments_.size(); s++) {
+			printf("Segment %zu: data points [%u,%u]\n", s,
+				spline.joints_[s], spline.joints_[s + 1]);
+		}
+		return 0;
+	}
+
+	/* with --batch many small curves are fitted as one batch */
+	// 10000 noisy cubic strokes of 64 points, like the contours of a font
+	if (argc > 1 && string(argv[1]) == "--batch") {
+		const int n_curves = 10000;
+		const int n = 64;
+		mt19937 emt(1);
+		uniform_real_distribution<double> position(-10.0, 10.0);
+		normal_distribution<double> noise(0.0, 0.01);
+		vector<vector<Vec2d>> curves(n_curves, vector<Vec2d>(n));
+		for (auto& curve : curves) {
+			vector<Vec2d> cubic(4);
+			for (auto& cp : cubic) {
+				cp = Vec2d{{position(emt), position(emt)}};
+			}
+			for (int k = 0; k < n; k++) {
+				const double t = k / (n - 1.0);
+				const double s = 1 - t;
+				for (int d = 0; d < 2; d++) {
+					curve[k][d] = s * s * s * cubic[0][d] + 3 * s * s * t * cubic[1][d]
+						+ 3 * s * t * t * cubic[2][d] + t * t * t * cubic[3][d]
+						+ noise(emt);
+				}
+			}
+		}
+		BatchFitOptions options;
+		for (const BatchMethod method : {BatchMethod::LeastSquares,
+			BatchMethod::DifferentialEvolution}) {
+			options.method = method;
+			options.iterations = method == BatchMethod::LeastSquares ? 8 : 50;
+			const auto start = chrono::steady_clock::now();
+			const vector<BatchFit> fits = fitBezierBatch(curves, options);
+			const double seconds = chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+			// median over the curves of the rms distance to the data
+			vector<double> rms;
+			for (const auto& fit : fits) {
+				rms.push_back(std::sqrt(fit.error_ / n));
+			}
+			nth_element(rms.begin(), rms.begin() + n_curves / 2, rms.end());
+			printf("%s: %.0f curves/s, median rms error %g\n",
+				method == BatchMethod::LeastSquares ? "Least squares"
+					: "Differential evolution",
+				n_curves / seconds, rms[n_curves / 2]);
+		}
+		return 0;
+	}
+
+	/* with --stream a sensor trace is fitted as it arrives */
+	// 100000 samples in batches of 1000, over a window of the last 20000;
+	// the DE keeps its population from one batch to the next
+	if (argc > 1 && string(argv[1]) == "--stream") {
+		const int n = 100000;
+		const int batch = 1000;
+		const size_t window = 20000;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.05);
+		BezierStream stream(4);
+		using JointThreadsDE =
+			pdebc::ThreadsDE<POPULATION_TYPE,pdebc::kDynamicDim,ERROR_TYPE>;
+		uniform_real_distribution<POPULATION_TYPE> ud(-DOMAIN_LIMITS, +DOMAIN_LIMITS);
+		JointThreadsDE de(BezierCurve::kDimensions * 2, 8, 0.8, POPULATION_SIZE, 0.5, 0.8,
+			bind(ud, emt),
+			[&stream](const vector<POPULATION_TYPE>& v) -> ERROR_TYPE {
+				return stream.calcErrorWithInnerControlPoints(v.data());
+			},
+			[](const ERROR_TYPE& a, const ERROR_TYPE& b) {
+				return a < b;
+			}, 1);
+		double update_seconds = 0;
+		double rebuild_seconds = 0;
+		for (int begin = 0; begin < n; begin += batch) {
+			vector<Vec2d> samples(batch);
+			for (int k = 0; k < batch; k++) {
+				const double x = (begin + k) * 1e-3;
+				samples[k] = Vec2d{{x + noise(emt), 10 * std::sin(x / 8) + noise(emt)}};
+			}
+			auto start = chrono::steady_clock::now();
+			stream.append(samples);
+			stream.retire(stream.size() > window ? stream.size() - window : 0);
+			stream.solveControlPointsWithLeastSquares();
+			update_seconds += chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+
+			// what the same update costs without the stream
+			start = chrono::steady_clock::now();
+			BezierCurve rebuilt{stream.dataPoints(), stream.control_points_};
+			rebuilt.solveControlPointsWithLeastSquares();
+			rebuild_seconds += chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+
+			// warm start: the population is judged again on the new window
+			de.reevaluatePopulation();
+			de.solveNGenerations(10);
+		}
+		const int updates = n / batch;
+		printf("Update: %.3f ms incremental, %.3f ms rebuilt\n",
+			1e3 * update_seconds / updates, 1e3 * rebuild_seconds / updates);
+		printf("Window error: least squares %g, DE %g\n",
+			std::sqrt(stream.calcError() / stream.size()),
+			std::sqrt(get<0>(de.getBestCandidate()) / stream.size()));
+		for (const auto& cp : stream.control_points_) {
+			printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+		}
+		return 0;
+	}
+
+	/* with --subsample the joint DE starts on a few of the data points */
+	// 200000 noisy samples of a cubic: the subsample grows as the
+	// population converges, the same run on all of them for reference
+	if (argc > 1 && string(argv[1]) == "--subsample") {
+		const vector<Vec2d> cubic{{{-10,0}}, {{0,20}}, {{20,-20}}, {{30,0}}};
+		const int n = 200000;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.05);
+		vector<tuple<double,Vec2d>> samples(n);
+		for (int k = 0; k < n; k++) {
+			const double t = k / (n - 1.0);
+			const double s = 1 - t;
+			Vec2d p;
+			for (int d = 0; d < 2; d++) {
+				p[d] = s * s * s * cubic[0][d] + 3 * s * s * t * cubic[1][d]
+					+ 3 * s * t * t * cubic[2][d] + t * t * t * cubic[3][d];
+				if (k > 0 && k < n - 1) {
+					p[d] += noise(emt);
+				}
+			}
+			samples[k] = tuple<double,Vec2d>{t, p};
+		}
+		vector<Vec2d> control_points(4);
+		control_points.front() = cubic.front();
+		control_points.back() = cubic.back();
+		BezierCurve curve{samples, control_points};
+		SubsampleOptions options;
+		options.generations = 120;
+		for (const size_t initial_size : {options.initial_size, static_cast<size_t>(n)}) {
+			options.initial_size = initial_size;
+			const auto start = chrono::steady_clock::now();
+			const SubsampledFit fit = fitWithSubsampledDE(curve, options);
+			const double seconds = chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+			printf("%s: %.3f s, error %.9g, subsample of up to %zu data points\n",
+				initial_size < n ? "Subsampled" : "Exact", seconds,
+				std::sqrt(fit.error_ / n), *max_element(fit.sample_sizes_.begin(),
+					fit.sample_sizes_.end()));
+		}
+		for (const auto& cp : curve.control_points_) {
+			printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+		}
+		return 0;
+	}
+
+	/* with --orthogonal the joint DE measures distances to the whole curve */
+	// a cubic sampled densely near its start but parameterized as if its
+	// samples were evenly spread: the fixed t-values bend the fit
+	if (argc > 1 && string(argv[1]) == "--orthogonal") {
+		const vector<Vec2d> cubic{{{-10,0}}, {{0,20}}, {{20,-20}}, {{30,0}}};
+		const int n = 500;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.01);
+		vector<tuple<double,Vec2d>> samples(n);
+		for (int k = 0; k < n; k++) {
+			const double t = std::pow(k / (n - 1.0), 2);
+			const double s = 1 - t;
+			Vec2d p;
+			for (int d = 0; d < 2; d++) {
+				p[d] = s * s * s * cubic[0][d] + 3 * s * s * t * cubic[1][d]
+					+ 3 * s * t * t * cubic[2][d] + t * t * t * cubic[3][d];
+				if (k > 0 && k < n - 1) {
+					p[d] += noise(emt);
+				}
+			}
+			samples[k] = tuple<double,Vec2d>{k / (n - 1.0), p};
+		}
+		vector<Vec2d> control_points(4);
+		control_points.front() = cubic.front();
+		control_points.back() = cubic.back();
+		BezierCurve curve{samples, control_points};
+		using JointThreadsDE =
+			pdebc::ThreadsDE<POPULATION_TYPE,pdebc::kDynamicDim,ERROR_TYPE>;
+		vector<POPULATION_TYPE> best;
+		for (const bool orthogonal : {false, true}) {
+			// a distance to the whole curve is small for any curve winding
+			// through the data, so that search stays around the data and
+			// starts from the fixed t-value fit
+			uniform_real_distribution<POPULATION_TYPE> ud(
+				orthogonal ? -40 : -DOMAIN_LIMITS, orthogonal ? 40 : DOMAIN_LIMITS);
+			JointThreadsDE de(BezierCurve::kDimensions * 2, 8, 0.8, POPULATION_SIZE, 0.5, 0.8,
+				bind(ud, mt19937(1)),
+				[&curve, orthogonal](const vector<POPULATION_TYPE>& v) -> ERROR_TYPE {
+					return orthogonal ? curve.calcOrthogonalErrorWithInnerControlPoints(v.data())
+						: curve.calcErrorWithInnerControlPoints(v.data());
+				},
+				[](const ERROR_TYPE& a, const ERROR_TYPE& b) {
+					return a < b;
+				}, 1);
+			const auto start = chrono::steady_clock::now();
+			if (orthogonal) {
+				de.injectCandidate(best);
+			}
+			de.solveNGenerations(200);
+			const double seconds = chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+			best = get<1>(de.getBestCandidate());
+			for (int i = 0; i < 2; i++) {
+				for (int d = 0; d < BezierCurve::kDimensions; d++) {
+					curve.control_points_[i + 1][d] = best[BezierCurve::kDimensions * i + d];
+				}
+			}
+			printf("%s error: %.3f s, orthogonal rms %g, control-points (%g,%g) (%g,%g)\n",
+				orthogonal ? "Orthogonal" : "Fixed t-value", seconds,
+				std::sqrt(curve.calcOrthogonalError() / n),
+				best[0], best[1], best[2], best[3]);
+		}
+		return 0;
+	}
+
+	/* with --rational the control points of a circular arc get weights */
+	// a rational quadratic draws the arc exactly, polynomials of any degree
+	// only approximate it
+	if (argc > 1 && string(argv[1]) == "--rational") {
+		const double radius = 50;
+		const double angle = 2 * M_PI / 3;
+		const int n = 500;
+		mt19937 emt(1);
+		normal_distribution<double> noise(0.0, 0.001);
+		vector<Vec2d> arc(n);
+		for (int k = 0; k < n; k++) {
+			const double a = angle * k / (n - 1);
+			arc[k] = Vec2d{{radius * std::cos(a), radius * std::sin(a)}};
+			if (k > 0 && k < n - 1) {
+				arc[k][0] += noise(emt);
+				arc[k][1] += noise(emt);
+			}
+		}
+		const auto t = calcChordLength(arc);
+		vector<tuple<double,Vec2d>> samples(n);
+		for (int k = 0; k < n; k++) {
+			samples[k] = tuple<double,Vec2d>{t[k], arc[k]};
+		}
+		for (const int cps : {3, 4, 5, 6}) {
+			vector<Vec2d> control_points(cps);
+			control_points.front() = arc.front();
+			control_points.back() = arc.back();
+			BezierCurve curve{samples, control_points};
+			curve.fitWithLeastSquares(50);
+			curve.polishWithLevenbergMarquardt(50);
+			printf("Polynomial, %d control points: orthogonal rms %g\n", cps,
+				std::sqrt(curve.calcOrthogonalError() / n));
+		}
+		// One DE over the inner control point and its weight. The weight is
+		// searched by its logarithm, v in the control point domain giving
+		// 8^(v / DOMAIN_LIMITS), so it stays positive.
+		vector<Vec2d> control_points(3);
+		control_points.front() = arc.front();
+		control_points.back() = arc.back();
+		BezierCurve curve{samples, control_points};
+		auto weight = [](const POPULATION_TYPE v) {
+			return std::pow(8.0, v / DOMAIN_LIMITS);
+		};
+		using JointThreadsDE =
+			pdebc::ThreadsDE<POPULATION_TYPE,pdebc::kDynamicDim,ERROR_TYPE>;
+		vector<POPULATION_TYPE> best;
+		for (const bool orthogonal : {false, true}) {
+			// the fixed t-values of the data points are not those of a
+			// rational arc, which is not traversed at constant speed: their
+			// fit only starts the search of the shape
+			uniform_real_distribution<POPULATION_TYPE> ud(-DOMAIN_LIMITS, DOMAIN_LIMITS);
+			JointThreadsDE de(BezierCurve::kDimensions + 1, 8, 0.8, POPULATION_SIZE, 0.5, 0.8,
+				bind(ud, mt19937(1)),
+				[&curve, &weight, orthogonal](const vector<POPULATION_TYPE>& v) -> ERROR_TYPE {
+					const double w = weight(v[BezierCurve::kDimensions]);
+					return orthogonal
+						? curve.calcOrthogonalErrorWithInnerControlPointsAndWeights(v.data(), &w)
+						: curve.calcErrorWithInnerControlPointsAndWeights(v.data(), &w);
+				},
+				[](const ERROR_TYPE& a, const ERROR_TYPE& b) {
+					return a < b;
+				}, 1);
+			const auto start = chrono::steady_clock::now();
+			if (orthogonal) {
+				de.injectCandidate(best);
+			}
+			de.solveNGenerations(200);
+			const double seconds = chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+			best = get<1>(de.getBestCandidate());
+			for (int d = 0; d < BezierCurve::kDimensions; d++) {
+				curve.control_points_[1][d] = best[d];
+			}
+			curve.setWeights({1, weight(best[BezierCurve::kDimensions]), 1});
+			printf("Rational, 3 control points, %s error: %.3f s, orthogonal rms %g, "
+				"control-point (%g,%g) weight %g\n",
+				orthogonal ? "orthogonal" : "fixed t-value", seconds,
+				std::sqrt(curve.calcOrthogonalError() / n), best[0], best[1],
+				curve.weights()[1]);
+		}
+		// with the weights fixed the curve is linear in its control points
+		// again, and Levenberg-Marquardt fits the t-values to the shape
+		printf("Rational, after Levenberg-Marquardt: rms %g (exact control-point "
+			"(%g,%g) weight %g)\n",
+			std::sqrt(curve.polishWithLevenbergMarquardt(50) / n),
+			radius, radius * std::tan(angle / 2), std::cos(angle / 2));
+		return 0;
+	}
+
+	/* with --joint a single DE searches every inner control point at once */
+	// its dimension, kDimensions * (CP - 2), is only known at run time
+	if (argc > 1 && string(argv[1]) == "--joint") {
+		const int inner_cps = bezier_curve.control_points_.size() - 2;
+		using JointThreadsDE =
+			pdebc::ThreadsDE<POPULATION_TYPE,pdebc::kDynamicDim,ERROR_TYPE>;
+		random_device rd;
+		mt19937 emt(rd());
+		uniform_real_distribution<POPULATION_TYPE> ud(-DOMAIN_LIMITS, +DOMAIN_LIMITS);
+		JointThreadsDE de(BezierCurve::kDimensions * inner_cps, 8, 0.8, POPULATION_SIZE, 0.5, 0.8,
+			bind(ud, emt),
+			[&bezier_curve](const vector<POPULATION_TYPE>& v) -> ERROR_TYPE {
+				return bezier_curve.calcErrorWithInnerControlPoints(v.data());
+			},
+			[](const ERROR_TYPE& a, const ERROR_TYPE& b) {
+				return a < b;
+			});
+		const auto start = chrono::steady_clock::now();
+		for (int i = 0; i < 100; i++) {
+			de.solveOneGeneration();
+			if (i % 10 == 9) {
+				const double seconds = chrono::duration<double>(
+					chrono::steady_clock::now() - start).count();
+				printf("Generation %d (%.3f s) error: %g\n", i, seconds,
+					std::sqrt(get<0>(de.getBestCandidate())));
+			}
+		}
+		const auto best = get<1>(de.getBestCandidate());
+		for (int i = 0; i < inner_cps; i++) {
+			for (int d = 0; d < BezierCurve::kDimensions; d++) {
+				bezier_curve.control_points_[i + 1][d] = best[BezierCurve::kDimensions * i + d];
+			}
+		}
+		for (const auto& cp : bezier_curve.control_points_) {
+			printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+		}
+		return 0;
+	}
+
 	/* lets create one "DE" algorithm for each control point */
 	
+	// with --jacobi both control points are searched at the same time,
+	// each against a copy of its cache taken at the start of the round
+	const bool jacobi = argc > 1 && string(argv[1]) == "--jacobi";
+
 	using MyThreadsDE =
 		pdebc::ThreadsDE<POPULATION_TYPE,POPULATION_DIM,ERROR_TYPE>;
 	vector<shared_ptr<MyThreadsDE>> des;
+	vector<VariableCPCache> caches(2);
 	for (int i = 0; i < 2; i++) {
 		// Since I will use the "OptimizationCache"
 		// We will have to update it any time we change
 		// control points
 		bezier_curve.updateVariableCPForOptimizationCache(i+1);
+		caches[i] = bezier_curve.getVariableCPCache();
 		// each DE will have a unique error calculation function
 		auto calc_error =
-			[&bezier_curve,i](const array<POPULATION_TYPE, POPULATION_DIM>& arr) -> ERROR_TYPE {
-				return bezier_curve.calcErrorWithOptimizationCache(arr);
+			[&caches,i](const array<POPULATION_TYPE, POPULATION_DIM>& arr) -> ERROR_TYPE {
+				return caches[i].calcError(arr);
 		};
 
 		/* lets create the callback functions */
@@ -143,15 +685,50 @@ int main(int argc, char *argv[]) {
 	for (int i = 0; i < 100; i++) {
 		printf("%s\n", string(40,'*').c_str());
 		printf("Generation %d:\n", i);
+		if (jacobi) {
+			for (int j = 0; j < 2; ++j) {
+				bezier_curve.updateVariableCPForOptimizationCache(j+1);
+				caches[j] = bezier_curve.getVariableCPCache();
+			}
+			for (auto& d : des) {
+				d->startGeneration();
+			}
+			for (auto& d : des) {
+				d->finishGeneration();
+			}
+			// both moves were searched against the old curve, take half of
+			// each so the round does not overshoot
+			for (int j = 0; j < 2; ++j) {
+				auto bc_point = get<1>(des[j]->getBestCandidate());
+				auto& cp = bezier_curve.control_points_[j+1];
+				cp[0] += 0.5 * (bc_point[0] - cp[0]);
+				cp[1] += 0.5 * (bc_point[1] - cp[1]);
+			}
+			printf("Error: %g\n", std::sqrt(bezier_curve.calcError()));
+			continue;
+		}
 		for (int j = 0; j < 2; ++j) {
 			bezier_curve.updateVariableCPForOptimizationCache(j+1);
+			caches[j] = bezier_curve.getVariableCPCache();
 			auto& d = des[j];
 			d->solveOneGeneration();
 			auto bc_error = get<0>(d->getBestCandidate());
 			auto bc_point = get<1>(d->getBestCandidate());
 			printf("Best candidate middle control-point: (%g,%g)\n", bc_point[0], bc_point[1]);
 			printf("Best Candidate error: %g\n", std::sqrt(bc_error));
+			// the cache also knows the exact answer of this subproblem
+			auto cf_point = bezier_curve.solveVariableCPWithOptimizationCache();
+			printf("Closed-form control-point: (%g,%g) error: %g\n", cf_point[0], cf_point[1],
+				std::sqrt(bezier_curve.getMinimumErrorWithOptimizationCache()));
 			bezier_curve.control_points_[j+1] = bc_point;
 		}
-	
-}}
\ No newline at end of file
+	}
+
+	/* DE is a poor tool for the last digits, polish its best fit */
+	const double polished_error = bezier_curve.polishWithLevenbergMarquardt(20);
+	printf("%s\n", string(40,'*').c_str());
+	printf("Levenberg-Marquardt polish error: %g\n", std::sqrt(polished_error));
+	for (const auto& cp : bezier_curve.control_points_) {
+		printf("Control-point: (%g,%g)\n", cp[0], cp[1]);
+	}
+}
@@ -6,6 +6,9 @@
 
 #include "pdebc/ThreadsDE.hpp"
 
+#include "BezierBatch.hpp"
+#include "BezierDegree.hpp"
+
 
 
 std::vector<double> calcChordLengthSwig(const std::vector<Vec2d>& data_points) {
@@ -13,25 +16,18 @@ std::vector<double> calcChordLengthSwig(const std::vector<Vec2d>& data_points) {
 	const int DP = data_points.size();
 	vector<double> chord_length(DP);
 	chord_length[0] = 0;
-	chord_length[DP - 1] = 1;
-
-	double td = 0;
 
+	// one sqrt per chord: the running sums are normalized afterwards
 	for (int i = 1; i < DP; i++) {
 		const double vdx = data_points[i][0] - data_points[i - 1][0];
 		const double vdy = data_points[i][1] - data_points[i - 1][1];
-		const double d = sqrt(vdx * vdx + vdy * vdy);
-		td += d;
+		chord_length[i] = chord_length[i - 1] + sqrt(vdx * vdx + vdy * vdy);
 	}
-
-	double p_td = 0;
+	const double td = chord_length[DP - 1];
 	for (int i = 1; i < DP; i++) {
-		const double vdx = data_points[i][0] - data_points[i - 1][0];
-		const double vdy = data_points[i][1] - data_points[i - 1][1];
-		const double d = sqrt(vdx * vdx + vdy * vdy);
-		p_td += d;
-		chord_length[i] = p_td / td;
+		chord_length[i] /= td;
 	}
+	chord_length[DP - 1] = 1;
 	return chord_length;
 }
 
@@ -62,8 +58,10 @@ pypde::pypde(const int n_processes, const int population_size,
 		= data_points_2dpos[data_points_2dpos.size()-1];
 
 	/* -2 because we dont try to fit the first and last control point */
+	caches_.resize(bezier_control_points-2);
 	for (int i = 0; i < bezier_control_points-2; i++) {
 		bezier_curve_->updateVariableCPForOptimizationCache(i+1);
+		caches_[i] = bezier_curve_->getVariableCPCache();
 
 		// population generator
 		auto t1 = chrono::high_resolution_clock::now().time_since_epoch();
@@ -80,7 +78,7 @@ pypde::pypde(const int n_processes, const int population_size,
 		// error calculation
 		auto calc_error =
 			[this,i](const array<POPULATION_TYPE, POPULATION_DIM>& arr) -> ERROR_TYPE {
-				return this->bezier_curve_->calcErrorWithOptimizationCache(arr);
+				return this->caches_[i].calcError(arr);
 		};
 		
 		
@@ -102,6 +100,7 @@ void pypde::solveOneGeneration()  {
 	using namespace std;
 	for (int j = 0; j < des_.size(); ++j) {
 		bezier_curve_->updateVariableCPForOptimizationCache(j+1);
+		caches_[j] = bezier_curve_->getVariableCPCache();
 		auto& d = des_[j];
 		d->solveOneGeneration();
 		//auto bc_error = get<0>(d.getBestCandidate());
@@ -112,6 +111,26 @@ void pypde::solveOneGeneration()  {
 	}
 }
 
+void pypde::solveOneGenerationJacobi(double damping) {
+	using namespace std;
+	for (size_t j = 0; j < des_.size(); ++j) {
+		bezier_curve_->updateVariableCPForOptimizationCache(j+1);
+		caches_[j] = bezier_curve_->getVariableCPCache();
+	}
+	for (auto& d : des_) {
+		d->startGeneration();
+	}
+	for (auto& d : des_) {
+		d->finishGeneration();
+	}
+	for (size_t j = 0; j < des_.size(); ++j) {
+		auto bc_point = get<1>(des_[j]->getBestCandidate());
+		auto& cp = bezier_curve_->control_points_[j+1];
+		cp[0] += damping * (bc_point[0] - cp[0]);
+		cp[1] += damping * (bc_point[1] - cp[1]);
+	}
+}
+
 double pypde::getBestCandidateError(int i) {
 	return std::get<0>(des_[i]->getBestCandidate());
 }
@@ -122,4 +141,72 @@ std::vector<double> pypde::getBestCandidateCP(int i) {
 	v[0] = p[0];
 	v[1] = p[1];
 	return v;
-}
\ No newline at end of file
+}
+
+double pypde::fitWithLeastSquares(int iterations) {
+	return bezier_curve_->fitWithLeastSquares(iterations);
+}
+
+double pypde::polishWithLevenbergMarquardt(int max_iterations) {
+	return bezier_curve_->polishWithLevenbergMarquardt(max_iterations);
+}
+
+std::vector<double> pypde::getControlPoint(int i) {
+	std::vector<double> v(2);
+	const auto& p = bezier_curve_->control_points_[i];
+	v[0] = p[0];
+	v[1] = p[1];
+	return v;
+}
+
+void pypde::setWeights(std::vector<double> weights) {
+	bezier_curve_->setWeights(weights);
+}
+
+std::vector<double> pypde::sampleCurve(int count) {
+	const size_t n = count > 0 ? count : 0;
+	std::vector<double> x(n);
+	std::vector<double> y(n);
+	double* out[2] = {x.data(), y.data()};
+	bezier_curve_->sampleUniformly(0, 1, n, out);
+	std::vector<double> v(2 * n);
+	for (size_t j = 0; j < n; j++) {
+		v[2 * j] = x[j];
+		v[2 * j + 1] = y[j];
+	}
+	return v;
+}
+
+int selectControlPoints(std::vector<Vec2> data_points, int max_control_points) {
+	std::vector<Vec2d> data_points_2dpos;
+	for (const auto& v : data_points) {
+		data_points_2dpos.push_back({{v.x,v.y}});
+	}
+	DegreeSelectionOptions options;
+	options.max_control_points = max_control_points;
+	return selectBezierDegree(data_points_2dpos, options).control_points_;
+}
+
+std::vector<std::vector<double>> fitCurves(
+	std::vector<std::vector<Vec2>> curves, int control_points, int iterations) {
+	using namespace std;
+	vector<vector<Vec2d>> batch(curves.size());
+	for (size_t c = 0; c < curves.size(); c++) {
+		for (const auto& v : curves[c]) {
+			batch[c].push_back({{v.x,v.y}});
+		}
+	}
+	BatchFitOptions options;
+	options.control_points = control_points;
+	options.iterations = iterations;
+	vector<vector<double>> result;
+	for (const auto& fit : fitBezierBatch(batch, options)) {
+		vector<double> cps;
+		for (const auto& p : fit.control_points_) {
+			cps.push_back(p[0]);
+			cps.push_back(p[1]);
+		}
+		result.push_back(move(cps));
+	}
+	return result;
+}
@@ -20,7 +20,7 @@ struct Vec2 {
 };
 
 #define POPULATION_SIZE 128
-#define POPULATION_DIM 2
+#define POPULATION_DIM BezierCurve::kDimensions
 #define POPULATION_TYPE double
 #define ERROR_TYPE double
 #define DOMAIN_LIMITS static_cast<double>(64)
@@ -30,6 +30,8 @@ using PYPDE_ThreadsDE = pdebc::ThreadsDE<POPULATION_TYPE,POPULATION_DIM,ERROR_TY
 struct pypde {
 	BezierCurve* bezier_curve_;
 	std::vector<std::shared_ptr<PYPDE_ThreadsDE>> des_;
+	// what des_[i] evaluates against: the cache of control point i+1
+	std::vector<VariableCPCache> caches_;
 
 	pypde(const int n_processes, const int population_size,
 		const int bezier_control_points,
@@ -39,7 +41,40 @@ struct pypde {
 
 	void solveOneGeneration();
 
+	// Every control point searched at the same time, each DE against a
+	// cache taken at the start of the round; the control points then move
+	// by `damping` (in (0,1]) of the way to the DE best candidates
+	void solveOneGenerationJacobi(double damping);
+
 	double getBestCandidateError(int i);
 
 	std::vector<double> getBestCandidateCP(int i);
-};
\ No newline at end of file
+
+	// Least-squares control points plus Newton reparameterization,
+	// returns the fit error
+	double fitWithLeastSquares(int iterations);
+
+	// Levenberg-Marquardt on the current control points (the DE best
+	// candidates) and parameterization, returns the fit error
+	double polishWithLevenbergMarquardt(int max_iterations);
+
+	std::vector<double> getControlPoint(int i);
+
+	// One weight (> 0) per control point makes the curve rational, e.g.
+	// 1, cos(a / 2), 1 for a circular arc of angle a; the DEs and fits
+	// then keep them fixed
+	void setWeights(std::vector<double> weights);
+
+	// The curve at `count` evenly spaced t-values in [0, 1], as
+	// x0, y0, x1, y1, ... for plotting
+	std::vector<double> sampleCurve(int count);
+};
+
+// Number of control points, in [2, max_control_points], that fits
+// data_points best by BIC; pass it to the pypde constructor
+int selectControlPoints(std::vector<Vec2> data_points, int max_control_points);
+
+// Least-squares fits of many curves at once on the shared thread pool;
+// element i holds the control points of curves[i] as x0, y0, x1, y1, ...
+std::vector<std::vector<double>> fitCurves(
+	std::vector<std::vector<Vec2>> curves, int control_points, int iterations);
@@ -7,6 +7,8 @@
 namespace std {
    %template(vectord) vector<double>;
    %template(vectorv) vector<Vec2>;
+   %template(vectorvv) vector<vector<Vec2>>;
+   %template(vectorvd) vector<vector<double>>;
 }
 
 //%include "pypde.hpp"
@@ -25,6 +27,17 @@ struct pypde {
 		std::vector<Vec2> data_points);
 	~pypde();
 	void solveOneGeneration();
+	void solveOneGenerationJacobi(double damping);
 	double getBestCandidateError(int i);
 	std::vector<double> getBestCandidateCP(int i);
-};
\ No newline at end of file
+	double fitWithLeastSquares(int iterations);
+	double polishWithLevenbergMarquardt(int max_iterations);
+	std::vector<double> getControlPoint(int i);
+	void setWeights(std::vector<double> weights);
+	std::vector<double> sampleCurve(int count);
+};
+
+int selectControlPoints(std::vector<Vec2> data_points, int max_control_points);
+
+std::vector<std::vector<double>> fitCurves(
+	std::vector<std::vector<Vec2>> curves, int control_points, int iterations);
@@ -19,8 +19,11 @@
 #ifndef BASEDE_H_
 #define BASEDE_H_
 
+#include <array>
+#include <cstdint>
 #include <functional>
 #include <tuple>
+#include <vector>
 
 //! pdebc namespace
 /*!
@@ -28,6 +31,37 @@
 */
 namespace pdebc {
 
+//! POP_DIM value for a number of dimensions chosen at run time.
+/*!
+	With it, population members are std::vector<POP_TYPE> and the
+	dimension is given to the constructor of the DE class.
+*/
+constexpr int kDynamicDim{-1};
+
+//! Storage of one population member: std::array<POP_TYPE,POP_DIM>.
+template <class POP_TYPE, int POP_DIM>
+struct CandidateTraits {
+	using type = std::array<POP_TYPE,POP_DIM>;
+
+	static type make(const int) {
+		return type{};
+	}
+};
+
+//! Storage of one population member of a kDynamicDim population.
+template <class POP_TYPE>
+struct CandidateTraits<POP_TYPE, kDynamicDim> {
+	using type = std::vector<POP_TYPE>;
+
+	static type make(const int dim) {
+		return type(dim);
+	}
+};
+
+//! Type of a population member (std::array, or std::vector for kDynamicDim).
+template <class POP_TYPE, int POP_DIM>
+using Candidate = typename CandidateTraits<POP_TYPE,POP_DIM>::type;
+
 //! Abstract/base class for every Differential Evolution class.
 /*!
 	BaseDE offers a generic interface for any DE class.
@@ -36,7 +70,7 @@ namespace pdebc {
 	It's use is optional. The usage of a children class directly is allowed.
 
 	\tparam POP_TYPE Population data type (usually 'double')
-	\tparam POP_DIM Population dimensions (usually 2D or 3D)
+	\tparam POP_DIM Population dimensions (usually 2D or 3D), or kDynamicDim
 	\tparam ERROR_TYPE Error type (usually 'double')
 */
 template <class POP_TYPE, int POP_DIM, class ERROR_TYPE>
@@ -44,10 +78,12 @@ struct BaseDE {
 
 	const double kCR_; ///< Mutation rate.
 	const double kF_; ///< Mutation weight.
+	const uint64_t kSeed_; ///< Seed of every random engine used by the solver.
+	const int kDim_; ///< Population dimensions (POP_DIM, unless it is kDynamicDim).
 
 	const std::function<POP_TYPE()>
 		callback_population_generator_; ///< Callback for the population generator function.
-	const std::function<ERROR_TYPE(const std::array<POP_TYPE,POP_DIM>&)>
+	const std::function<ERROR_TYPE(const Candidate<POP_TYPE,POP_DIM>&)>
 		callback_calc_error_; ///< Callback for the error calculator function.
 	const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>
 		callback_error_evaluation_; ///< Callback for the error evaluator function.
@@ -65,16 +101,22 @@ struct BaseDE {
 			parameters.
 		\param callback_calc_error Function used to calculate the error with a single
 			member of the population. It must return a ERROR_TYPE type and takes an
-			array containg a single population entity as input parameter.
+			array (a vector for kDynamicDim) containg a single population entity as input parameter.
 		\param callback_error_evaluation Fuction used to compare two ERROR_TYPE. It
 			must return a bool. In case of true, the population from the first ERROR_TYPE
 			will be picked as best candidate. Try to figure out what happens in case of false xD.
+		\param seed Seed for the random engines of the solver. Two solvers built
+			with the same seed (and the same population generator) walk through
+			the same sequence of random numbers.
+		\param dim Population dimensions, only used when POP_DIM is kDynamicDim.
 	*/
 	BaseDE(const double CR, const double F,
 		const std::function<POP_TYPE()>&& callback_population_generator,
-		const std::function<ERROR_TYPE(const std::array<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
-		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation) :
-			kCR_{CR}, kF_{F},
+		const std::function<ERROR_TYPE(const Candidate<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
+		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation,
+		const uint64_t seed, const int dim = POP_DIM) :
+			kCR_{CR}, kF_{F}, kSeed_{seed},
+			kDim_{POP_DIM == kDynamicDim ? dim : POP_DIM},
 			callback_population_generator_{callback_population_generator},
 			callback_calc_error_{callback_calc_error},
 			callback_error_evaluation_{callback_error_evaluation} {
@@ -96,7 +138,32 @@ struct BaseDE {
 		Will go through the entire population looking for the best candidate.
 		The choice is based on the results of the BaseDE::callback_calc_error_ function.
 	*/
-	virtual std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>> getBestCandidate() = 0;
+	virtual std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>> getBestCandidate() = 0;
+	//! It evaluates the whole population again.
+	/*!
+		For an error function that changed since the population was
+		evaluated (e.g. more data to fit): the population is kept, so the
+		run warm-starts from where it was instead of from scratch. An
+		uninitialized population is generated and evaluated.
+
+		The default does nothing, so solvers written before it still build;
+		SequentialDE and ThreadsDE override it.
+	*/
+	virtual void reevaluatePopulation() {
+
+	}
+	//! It replaces the worst member of the population with `candidate`.
+	/*!
+		The candidate is evaluated with BaseDE::callback_calc_error_. Use it
+		to seed a run with a known good solution, such as the previous fit.
+		\param candidate Population entity to add.
+
+		The default ignores the candidate; SequentialDE and ThreadsDE
+		override it.
+	*/
+	virtual void injectCandidate(const Candidate<POP_TYPE,POP_DIM>& candidate) {
+		(void)candidate;
+	}
 
 protected:
 	~BaseDE() {
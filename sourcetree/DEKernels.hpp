@@ -0,0 +1,138 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef DEKERNELS_HPP_
+#define DEKERNELS_HPP_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "BaseDE.hpp"
+
+/// \cond DEV
+namespace pdebc {
+
+//! Steps of one DE generation, shared by SequentialDE and ThreadsDESolver.
+/*!
+	They are free functions so they can be benchmarked in isolation.
+*/
+namespace kernels {
+
+//! Picks three distinct population indices (DE/rand/1 donors).
+template <class RANDOM_INDEX>
+inline void sampleDistinctIndices(RANDOM_INDEX& random_index,
+	uint32_t& it0, uint32_t& it1, uint32_t& it2) {
+	it0 = random_index();
+	it1 = random_index();
+	while (it1 == it0) {
+		it1 = random_index();
+	}
+	it2 = random_index();
+	while (it2 == it1 || it2 == it0) {
+		it2 = random_index();
+	}
+}
+
+//! Builds the trial of `target` from the donors `p0 + F * (p1 - p2)`.
+/*!
+	Dimension `j` is always mutated, every other dimension is mutated with
+	probability CR (binomial crossover).
+*/
+template <class POP_TYPE, int POP_DIM, class RANDOM_CR>
+inline void buildTrial(const Candidate<POP_TYPE,POP_DIM>& target,
+	const Candidate<POP_TYPE,POP_DIM>& p0,
+	const Candidate<POP_TYPE,POP_DIM>& p1,
+	const Candidate<POP_TYPE,POP_DIM>& p2,
+	const double F, const double CR, int j, RANDOM_CR& random_cr,
+	Candidate<POP_TYPE,POP_DIM>& candidate) {
+	// a constant unless POP_DIM is kDynamicDim
+	const int dim = static_cast<int>(target.size());
+	candidate[j] = p0[j] + F * (p1[j] - p2[j]);
+	j = (j + 1) % dim;
+
+	for (int k = 1; k < dim; ++k) {
+		if (random_cr() <= CR) {
+			candidate[j] = p0[j] + F * (p1[j] - p2[j]);
+		} else {
+			candidate[j] = target[j];
+		}
+		j = (j + 1) % dim;
+	}
+}
+
+//! Replaces population member `i` with `candidate` when its error is better.
+/*!
+	\return true when the candidate was accepted.
+*/
+template <class CANDIDATE, class ERROR_TYPE, class CALC_ERROR, class ERROR_EVALUATION>
+inline bool selectTrial(const uint32_t i,
+	const CANDIDATE& candidate,
+	std::vector<CANDIDATE>& population,
+	std::vector<ERROR_TYPE>& errors,
+	const CALC_ERROR& calc_error, const ERROR_EVALUATION& error_evaluation) {
+	ERROR_TYPE error_new = calc_error(candidate);
+
+	if (error_evaluation(error_new, errors[i])) {
+		population[i] = candidate;
+		errors[i] = error_new;
+		return true;
+	}
+	return false;
+}
+
+//! Index of the best error (the first one, on ties).
+template <class ERROR_TYPE, class ERROR_EVALUATION>
+inline uint32_t bestCandidateIndex(const std::vector<ERROR_TYPE>& errors,
+	const ERROR_EVALUATION& error_evaluation) {
+	uint32_t best = 0;
+	for (uint32_t i = 1; i < errors.size(); ++i) {
+		if (error_evaluation(errors[i], errors[best])) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+//! Index of the worst error (the last one, on ties).
+template <class ERROR_TYPE, class ERROR_EVALUATION>
+inline uint32_t worstCandidateIndex(const std::vector<ERROR_TYPE>& errors,
+	const ERROR_EVALUATION& error_evaluation) {
+	uint32_t worst = 0;
+	for (uint32_t i = 1; i < errors.size(); ++i) {
+		if (!error_evaluation(errors[i], errors[worst])) {
+			worst = i;
+		}
+	}
+	return worst;
+}
+
+//! Replaces the worst population member with `candidate`, whose error is `error`.
+template <class CANDIDATE, class ERROR_TYPE, class ERROR_EVALUATION>
+inline void replaceWorst(const CANDIDATE& candidate, const ERROR_TYPE& error,
+	std::vector<CANDIDATE>& population, std::vector<ERROR_TYPE>& errors,
+	const ERROR_EVALUATION& error_evaluation) {
+	const uint32_t worst = worstCandidateIndex(errors, error_evaluation);
+	population[worst] = candidate;
+	errors[worst] = error;
+}
+
+} // namespace kernels
+} // namespace pdebc
+/// \endcond
+
+#endif /* DEKERNELS_HPP_ */
@@ -27,20 +27,21 @@
 #include <random>
 
 #include "BaseDE.hpp"
+#include "DEKernels.hpp"
 
 namespace pdebc {
 
 //! Sequential implementation of the Differential Evolution algorithm.
 /*!
 	\tparam POP_TYPE Population data type (usually 'double')
-	\tparam POP_DIM Population dimensions (usually 2D or 3D)
+	\tparam POP_DIM Population dimensions (usually 2D or 3D), or kDynamicDim
 	\tparam ERROR_TYPE Error type (usually 'double')
 */
 template <class POP_TYPE, int POP_DIM, class ERROR_TYPE>
 struct SequentialDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 
 	const uint32_t kPopSize_; ///< Population size;
-	std::vector<std::array<POP_TYPE,POP_DIM>> population_; ///< Entire population.
+	std::vector<Candidate<POP_TYPE,POP_DIM>> population_; ///< Entire population.
 
 	/*!
 		\param POP_SIZE Population size.
@@ -60,40 +61,72 @@ struct SequentialDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 		\param callback_error_evaluation Fuction used to compare two ERROR_TYPE. It
 			must return a bool. In case of true, the population from the first ERROR_TYPE
 			will be picked as best candidate. Try to figure out what happens in case of false xD.
+		\param seed Seed for the random engines. Defaults to a std::random_device value.
+
+		Construction does not evaluate anything: the population is generated
+		and evaluated on the first call to solveOneGeneration() or getBestCandidate().
 	*/
 	SequentialDE(const uint32_t POP_SIZE, const double CR, const double F,
 		const std::function<POP_TYPE()>&& callback_population_generator,
-		const std::function<ERROR_TYPE(const std::array<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
-		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation) :
+		const std::function<ERROR_TYPE(const Candidate<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
+		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation,
+		const uint64_t seed = std::random_device{}()) :
+			SequentialDE(POP_DIM, POP_SIZE, CR, F,
+				std::move(callback_population_generator),
+				std::move(callback_calc_error),
+				std::move(callback_error_evaluation),
+				seed) {
+		static_assert(POP_DIM != kDynamicDim,
+			"a kDynamicDim population needs the constructor taking its dimension");
+	}
+
+	//! Constructor for a population whose dimension is chosen at run time.
+	/*!
+		\param dim Population dimensions. It is only used when POP_DIM is
+			kDynamicDim; candidates are then std::vector<POP_TYPE> of that size.
+
+		The other parameters are the same as in the constructor above.
+	*/
+	SequentialDE(const int dim, const uint32_t POP_SIZE, const double CR, const double F,
+		const std::function<POP_TYPE()>&& callback_population_generator,
+		const std::function<ERROR_TYPE(const Candidate<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
+		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation,
+		const uint64_t seed = std::random_device{}()) :
 			kPopSize_{POP_SIZE},
 			BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE>(
 				CR, F,
 				std::move(callback_population_generator),
 				std::move(callback_calc_error),
-				std::move(callback_error_evaluation)) {
+				std::move(callback_error_evaluation),
+				seed, dim),
+			initialized_{false} {
 
-		population_.resize(kPopSize_);
+		population_.assign(kPopSize_,
+			CandidateTraits<POP_TYPE,POP_DIM>::make(this->kDim_));
+		pop_candidate_ = CandidateTraits<POP_TYPE,POP_DIM>::make(this->kDim_);
 		pop_errors_.resize(kPopSize_);
 		
-		// Initialize random_cr_
+		// Each random engine gets its own seed derived from kSeed_
 		using namespace std;
-		random_device rd;
-  		mt19937 emt(rd());
+		seed_seq seq{static_cast<uint32_t>(this->kSeed_),
+			static_cast<uint32_t>(this->kSeed_ >> 32)};
+		array<uint32_t, 3> seeds;
+		seq.generate(seeds.begin(), seeds.end());
+
+		// Initialize random_cr_
+  		mt19937 emt(seeds[0]);
   		uniform_real_distribution<double> ud(0.0, 1.0);
   		random_cr_ = bind(ud, emt);
 
   		// Initialize random_trials_
-  		mt19937 emt2(rd());
+  		mt19937 emt2(seeds[1]);
   		uniform_int_distribution<uint32_t> ui2(0, kPopSize_-1);
   		random_trials_ = bind(ui2, emt2);
 
   		// Initialize random_j_
-  		mt19937 emt3(rd());
-  		uniform_int_distribution<uint32_t> ui3(0.0, POP_DIM-1);
+  		mt19937 emt3(seeds[2]);
+  		uniform_int_distribution<uint32_t> ui3(0, this->kDim_-1);
   		random_j_ = bind(ui3, emt3);
-
-		generatePopulation();
-		calcGenerationError();
 	}
 
 	~SequentialDE() {
@@ -101,6 +134,7 @@ struct SequentialDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 	}
 
 	void solveOneGeneration() {
+		initialize();
 		for (uint32_t i = 0; i < kPopSize_; i++) {
 			mutation(i);
 			select(i);
@@ -116,15 +150,31 @@ struct SequentialDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 	/*!
 		This operation has an O(N) complexity, where N is the population size.
 	*/
-	std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>> getBestCandidate() {
-		
-		auto e = std::min_element(pop_errors_.begin(), pop_errors_.end(),
+	std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>> getBestCandidate() {
+		initialize();
+		const uint32_t min = kernels::bestCandidateIndex(pop_errors_,
 			this->callback_error_evaluation_);
-		auto min = std::distance(pop_errors_.begin(), e);
 
-		std::array<POP_TYPE,POP_DIM> r = population_[min];
+		return std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>>{pop_errors_[min],population_[min]};
+	}
+
+	/*!
+		This operation has an O(N) complexity, where N is the population size.
+	*/
+	void reevaluatePopulation() {
+		if (initialized_) {
+			calcGenerationError();
+		} else {
+			initialize();
+		}
+	}
 
-		return std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>>{pop_errors_[min],r};
+	void injectCandidate(const Candidate<POP_TYPE,POP_DIM>& candidate) {
+		initialize();
+		pop_candidate_ = candidate;
+		const ERROR_TYPE error = this->callback_calc_error_(pop_candidate_);
+		kernels::replaceWorst(pop_candidate_, error, population_, pop_errors_,
+			this->callback_error_evaluation_);
 	}
 
 
@@ -133,16 +183,21 @@ private:
 	std::function<uint32_t()> random_trials_;
 	std::function<uint32_t()> random_j_;
 
-	template <class T, unsigned I, unsigned J>
-	using Matrix = std::array<std::array<T, J>, I>;
-
-	Matrix<POP_TYPE, 3, POP_DIM> pop_trials_; // Used in "mutation"
-	std::array<POP_TYPE, POP_DIM> pop_candidate_;
+	Candidate<POP_TYPE,POP_DIM> pop_candidate_;
 	std::vector<ERROR_TYPE> pop_errors_;
+	bool initialized_;
+
+	void initialize() {
+		if (!initialized_) {
+			generatePopulation();
+			calcGenerationError();
+			initialized_ = true;
+		}
+	}
 
 	void generatePopulation() {
 		for (uint32_t i = 0; i < kPopSize_; ++i) {
-			for (int d = 0; d < POP_DIM; ++d) {
+			for (int d = 0; d < this->kDim_; ++d) {
 				population_[i][d] = this->callback_population_generator_();
 			}
 		}
@@ -156,47 +211,21 @@ private:
 	}
 
 	void mutation(const uint32_t actual_index) {
-		int j = random_j_();
+		const int j = random_j_();
 
-		const uint32_t it0 = random_trials_();
-		uint32_t it1 = random_trials_();
-		while (it1 == it0) {
-			it1 = random_trials_();
-		}
-		uint32_t it2 = random_trials_();
-		while (it2 == it1 || it2 == it0) {
-			it2 = random_trials_();
-		}
-
-		for (int d = 0; d < POP_DIM; d++) {
-			pop_trials_[0][d] = population_[it0][d];
-			pop_trials_[1][d] = population_[it1][d];
-			pop_trials_[2][d] = population_[it2][d];
-		}
+		uint32_t it0, it1, it2;
+		kernels::sampleDistinctIndices(random_trials_, it0, it1, it2);
 
-		pop_candidate_[j] = pop_trials_[0][j] + this->kF_ * (pop_trials_[1][j] - pop_trials_[2][j]);
-		j = (j + 1) % POP_DIM;
-
-		for (int k = 1; k < POP_DIM; ++k) {
-			if (random_cr_() <= this->kCR_) {
-				pop_candidate_[j] = pop_trials_[0][j] + this->kF_ * (pop_trials_[1][j] - pop_trials_[2][j]);
-		    } else {
-		      	pop_candidate_[j] = population_[actual_index][j];
-		    }
-		    j = (j + 1) % POP_DIM;
-	    }
+		kernels::buildTrial<POP_TYPE,POP_DIM>(population_[actual_index],
+			population_[it0], population_[it1], population_[it2],
+			this->kF_, this->kCR_, j, random_cr_, pop_candidate_);
 	}
 	
 
 	void select(const uint32_t actual_index) {
-		ERROR_TYPE error_new = this->callback_calc_error_(pop_candidate_);
-
-		if (this->callback_error_evaluation_(error_new, pop_errors_[actual_index])) {
-			for (int d = 0; d < POP_DIM; d++) {
-				population_[actual_index][d] = pop_candidate_[d];
-			}
-			pop_errors_[actual_index] = error_new;
-		}
+		kernels::selectTrial(actual_index, pop_candidate_, population_,
+			pop_errors_, this->callback_calc_error_,
+			this->callback_error_evaluation_);
 	}
 };
 
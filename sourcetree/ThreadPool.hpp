@@ -0,0 +1,175 @@
+/*
+ Copyright 2012 Allan Yoshio Hasegawa
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pdebc {
+
+//! Fixed set of worker threads shared by every ThreadsDE.
+/*!
+	Threads are created once, when the pool is built, and reused by every
+	solver afterwards, so building a ThreadsDE does not spawn threads.
+	Tasks are intrusive (see ThreadPool::Task): submitting work never
+	allocates.
+
+	A thread waiting for a task may call runPendingTask() to help the pool
+	instead of sleeping. This lets pool tasks wait for other tasks (e.g. a
+	batch of fits, each one driving a ThreadsDE) without deadlocking.
+*/
+struct ThreadPool {
+
+	//! Work item. A task may be queued at most once at a time.
+	struct Task {
+		//! Called by a pool thread (or by a helping thread).
+		virtual void execute() = 0;
+
+	protected:
+		~Task() {
+		}
+
+	private:
+		friend struct ThreadPool;
+		Task* next_pool_task_{nullptr};
+	};
+
+	//! \param n_threads Number of worker threads (at least one is created).
+	explicit ThreadPool(const uint32_t n_threads)
+		: kNThreads_{std::max(1u, n_threads)}, finish_{false},
+			head_{nullptr}, tail_{nullptr} {
+		for (uint32_t k = 0; k < kNThreads_; ++k) {
+			threads_.emplace_back(&ThreadPool::run, this, static_cast<int>(k));
+		}
+	}
+
+	//! Runs the tasks still queued, then joins the threads.
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			finish_ = true;
+			cond_.notify_all();
+		}
+		for (auto& t : threads_) {
+			t.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//! Process wide pool, with one thread per hardware thread.
+	/*!
+		It is created the first time it is used.
+	*/
+	static ThreadPool& shared() {
+		static ThreadPool pool(std::thread::hardware_concurrency());
+		return pool;
+	}
+
+	uint32_t size() const {
+		return kNThreads_;
+	}
+
+	//! Queues `task` (FIFO). It must stay alive until it has been executed.
+	void submit(Task* task) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		task->next_pool_task_ = nullptr;
+		if (tail_) {
+			tail_->next_pool_task_ = task;
+		} else {
+			head_ = task;
+		}
+		tail_ = task;
+		cond_.notify_one();
+	}
+
+	//! Runs one queued task on the calling thread.
+	/*!
+		\return false when the queue was empty.
+	*/
+	bool runPendingTask() {
+		Task* task = pop();
+		if (!task) {
+			return false;
+		}
+		task->execute();
+		return true;
+	}
+
+	//! Index of the calling pool thread in [0, size()), or -1 for other threads.
+	static int workerIndex() {
+		return workerIndexStorage();
+	}
+
+private:
+	const uint32_t kNThreads_;
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	bool finish_;
+	Task* head_;
+	Task* tail_;
+
+	static int& workerIndexStorage() {
+		static thread_local int index = -1;
+		return index;
+	}
+
+	Task* pop() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return popLocked();
+	}
+
+	Task* popLocked() {
+		Task* task = head_;
+		if (task) {
+			head_ = task->next_pool_task_;
+			if (!head_) {
+				tail_ = nullptr;
+			}
+		}
+		return task;
+	}
+
+	void run(const int index) {
+		workerIndexStorage() = index;
+		for (;;) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			cond_.wait(lock, [this]() {
+				return this->finish_ || this->head_;
+			});
+			Task* task = popLocked();
+			lock.unlock();
+
+			if (!task) {
+				return; // finish_ and nothing left to run
+			}
+			task->execute();
+		}
+	}
+};
+
+} // namespace pdebc
+
+#endif /* THREADPOOL_HPP_ */
@@ -22,16 +22,19 @@
 #include <tuple>
 #include <algorithm>
 #include <chrono>
+#include <random>
+#include <memory>
 
 #include "BaseDE.hpp"
 #include "ThreadsDESolver.hpp"
+#include "ThreadPool.hpp"
 
 namespace pdebc {
 
 //! Multi thread implementation of the Differential Evolution algorithm.
 /*!
 	\tparam POP_TYPE Population data type (usually 'double')
-	\tparam POP_DIM Population dimensions (usually 2D or 3D)
+	\tparam POP_DIM Population dimensions (usually 2D or 3D), or kDynamicDim
 	\tparam ERROR_TYPE Error type (usually 'double')
 */
 template <class POP_TYPE, int POP_DIM, class ERROR_TYPE>
@@ -66,34 +69,75 @@ struct ThreadsDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 		\param callback_error_evaluation Fuction used to compare two ERROR_TYPE. It
 			must return a bool. In case of true, the population from the first ERROR_TYPE
 			will be picked as best candidate. Try to figure out what happens in case of false xD.
+		\param seed Seed for the random engines. Each thread derives its own
+			engines from it. Defaults to a std::random_device value.
+		\param pool Pool running the work of the threads. Defaults to
+			ThreadPool::shared(), so solvers reuse the same threads.
+
+		Construction does not evaluate anything. The first call to
+		solveOneGeneration() or getBestCandidate() generates the parts of the
+		population one thread after the other, so the same seed gives the same
+		population, then each thread evaluates its part.
 	*/
 	ThreadsDE(const uint32_t n_process, const double migration_phi,
 		const uint32_t POP_SIZE, const double CR, const double F,
 		const std::function<POP_TYPE()>&& callback_population_generator,
-		const std::function<ERROR_TYPE(const std::array<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
-		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation) :
+		const std::function<ERROR_TYPE(const Candidate<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
+		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation,
+		const uint64_t seed = std::random_device{}(),
+		ThreadPool& pool = ThreadPool::shared()) :
+			ThreadsDE(POP_DIM, n_process, migration_phi, POP_SIZE, CR, F,
+				std::move(callback_population_generator),
+				std::move(callback_calc_error),
+				std::move(callback_error_evaluation),
+				seed, pool) {
+		static_assert(POP_DIM != kDynamicDim,
+			"a kDynamicDim population needs the constructor taking its dimension");
+	}
+
+	//! Constructor for a population whose dimension is chosen at run time.
+	/*!
+		\param dim Population dimensions. It is only used when POP_DIM is
+			kDynamicDim; candidates are then std::vector<POP_TYPE> of that size.
+
+		The other parameters are the same as in the constructor above.
+	*/
+	ThreadsDE(const int dim, const uint32_t n_process, const double migration_phi,
+		const uint32_t POP_SIZE, const double CR, const double F,
+		const std::function<POP_TYPE()>&& callback_population_generator,
+		const std::function<ERROR_TYPE(const Candidate<POP_TYPE,POP_DIM>&)>&& callback_calc_error,
+		const std::function<bool(const ERROR_TYPE&,const ERROR_TYPE&)>&& callback_error_evaluation,
+		const uint64_t seed = std::random_device{}(),
+		ThreadPool& pool = ThreadPool::shared()) :
 			kNProcess_{n_process}, kMigrationPhi_{migration_phi},kPopSize_{POP_SIZE},
 			BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE>(
 				CR, F,
 				std::move(callback_population_generator),
 				std::move(callback_calc_error),
-				std::move(callback_error_evaluation)) {
+				std::move(callback_error_evaluation),
+				seed, dim),
+			generated_{false}, next_injection_{0} {
 
 		// Initialize random functions for the
 		// migration step...
 		using namespace std;
-		mt19937 emt(random_device{}());
+		seed_seq seq{static_cast<uint32_t>(this->kSeed_),
+			static_cast<uint32_t>(this->kSeed_ >> 32)};
+		array<uint32_t, 2> seeds;
+		seq.generate(seeds.begin(), seeds.end());
+
+		mt19937 emt(seeds[0]);
 		uniform_real_distribution<double> ud(0.0, 1.0);
 		random_phi_ = bind(ud, emt);
 
-		mt19937 emt2(random_device{}());
+		mt19937 emt2(seeds[1]);
 		uniform_int_distribution<uint32_t> ui2(0, (kPopSize_/kNProcess_)-1);
 		random_migration_index_ = bind(ui2, emt2);
 
 		// Initialize each solver...
   		using MyThreadsDESolver = pdebc::ThreadsDESolver<POP_TYPE,POP_DIM,ERROR_TYPE>;
 		for (int k = 0; k < kNProcess_; k++) {
-			auto solver = shared_ptr<MyThreadsDESolver>(new MyThreadsDESolver(k,kPopSize_/kNProcess_,this));
+			auto solver = shared_ptr<MyThreadsDESolver>(new MyThreadsDESolver(k,kPopSize_/kNProcess_,this,pool));
 			solvers_.push_back(solver);
 		}
 	}
@@ -107,9 +151,28 @@ struct ThreadsDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 		This is a blocking operation.
 	*/
 	void solveOneGeneration() {
+		startGeneration();
+		finishGeneration();
+	}
+
+	//! Starts one generation on the pool and returns without waiting.
+	/*!
+		Several solvers can have a generation in flight at the same time,
+		so they all keep the pool busy. Call finishGeneration() before
+		anything else on this solver.
+	*/
+	void startGeneration() {
+		generatePopulations();
 		for (auto& s : solvers_) {
 			s->solveOneGeneration();
 		}
+	}
+
+	//! Waits for the generation started by startGeneration(), then migrates.
+	/*!
+		This is a blocking operation.
+	*/
+	void finishGeneration() {
 		for (auto& s : solvers_) {
 			s->waitWork();
 		}
@@ -126,15 +189,16 @@ struct ThreadsDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 		This operation has an O(N) complexity, where N is the population size, but
 		the work will be divided by ThreadsDE::kNProcess_ threads.
 	*/
-	std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>> getBestCandidate() {
+	std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>> getBestCandidate() {
 		using namespace std;
+		generatePopulations();
 
 		for (auto& s : solvers_) {
 			s->solveBestCandidate();
 		}
 		solvers_[0]->waitWork();
 		double min_error = get<0>(solvers_[0]->getBestCandidate());
-		array<POP_TYPE,POP_DIM> min_error_pos = get<1>(solvers_[0]->getBestCandidate());;
+		Candidate<POP_TYPE,POP_DIM> min_error_pos = get<1>(solvers_[0]->getBestCandidate());
 		
 		for (auto& s : solvers_) {
 			s->waitWork();
@@ -145,14 +209,62 @@ struct ThreadsDE : public BaseDE<POP_TYPE, POP_DIM, ERROR_TYPE> {
 			}
 		}
 
-		return std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>>{min_error,min_error_pos};
+		return std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>>{min_error,min_error_pos};
+	}
+
+	/*!
+		Each thread evaluates its part of the population again, on the pool.
+	*/
+	void reevaluatePopulation() {
+		generatePopulations();
+		for (auto& s : solvers_) {
+			s->solveReevaluation();
+		}
+		for (auto& s : solvers_) {
+			s->waitWork();
+		}
+	}
+
+	/*!
+		The candidates go to the threads in turn, each replacing the worst
+		member of that thread's part of the population.
+	*/
+	void injectCandidate(const Candidate<POP_TYPE,POP_DIM>& candidate) {
+		generatePopulations();
+		auto& s = solvers_[next_injection_ % solvers_.size()];
+		++next_injection_;
+		s->waitWork();
+		s->inject(candidate);
+	}
+
+	//! Runs the migration step alone, as it runs after every generation.
+	/*!
+		Meant for timing it; solveOneGeneration() already migrates. This is
+		a blocking operation.
+	*/
+	void migrateOnce() {
+		generatePopulations();
+		migration();
 	}
 
 private:
+	bool generated_;
+	uint32_t next_injection_;
 	std::function<double()> random_phi_;
 	std::function<uint32_t()> random_migration_index_;
 	std::vector<std::shared_ptr<ThreadsDESolver<POP_TYPE,POP_DIM,ERROR_TYPE>>> solvers_;
 
+	// Serial, in island order: the population generator is shared
+	void generatePopulations() {
+		if (generated_) {
+			return;
+		}
+		for (auto& s : solvers_) {
+			s->generate();
+		}
+		generated_ = true;
+	}
+
 	// new step for the parallel solution ;)
 	void migration() {
 		using namespace std;
@@ -160,13 +272,16 @@ private:
 		for (auto& s : solvers_) {
 			s->solveBestCandidate();
 		}
+		// every island must be idle before a migrant lands on it
+		for (auto& s : solvers_) {
+			s->waitWork();
+		}
 
 		for (int i = 0; i < solvers_.size(); ++i) {
 			if (random_phi_() < kMigrationPhi_) {
-				solvers_[i]->waitWork();
-				auto bc = get<1>(solvers_[i]->getBestCandidate());
 				const uint32_t mi = random_migration_index_();
-				solvers_[(i+1)%solvers_.size()]->population_[mi] = bc;
+				solvers_[(i+1)%solvers_.size()]->immigrate(mi,
+					solvers_[i]->getBestCandidate());
 			}
 		}
 	}
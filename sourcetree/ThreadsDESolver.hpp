@@ -19,84 +19,177 @@
 #ifndef THREADSDESOLVER_H_
 #define THREADSDESOLVER_H_
 
-#include <thread>
 #include <random>
 #include <mutex>
 #include <condition_variable>
 #include <algorithm>
  
 #include "BaseDE.hpp"
+#include "DEKernels.hpp"
+#include "ThreadPool.hpp"
 
 /// \cond DEV
 namespace pdebc {
 
 enum class WorkType {
 	SOLVE_GENERATION,
-	GET_BEST_CANDIDATE
+	GET_BEST_CANDIDATE,
+	REEVALUATE_POPULATION
 };
 
 
 //! ThreadsDE internal class.
 /*!
 	This class is used by ThreadsDE privately, so, Doxygen will ignore it :3
+
+	Each solver owns one island of the population. Its work runs as a task
+	on a ThreadPool; the island is evaluated lazily, by the first task, so
+	building a solver is cheap. ThreadsDE generates the islands beforehand,
+	one after the other, so the shared population generator is called in
+	island order.
 */
 template <class POP_TYPE, int POP_DIM, class ERROR_TYPE>
-struct ThreadsDESolver {
+struct ThreadsDESolver : public ThreadPool::Task {
 
 	const int kID_;
 	const uint32_t kPopSize_;
 	BaseDE<POP_TYPE,POP_DIM,ERROR_TYPE>* base_de_;
 
-	std::vector<std::array<POP_TYPE,POP_DIM>> population_;
+	std::vector<Candidate<POP_TYPE,POP_DIM>> population_;
 
 	ThreadsDESolver(const int id, const uint32_t POP_SIZE,
-		BaseDE<POP_TYPE,POP_DIM,ERROR_TYPE>* base_de)
+		BaseDE<POP_TYPE,POP_DIM,ERROR_TYPE>* base_de, ThreadPool& pool)
 		: kID_{id}, kPopSize_{POP_SIZE},
-			base_de_{base_de}, finish_{false}, pending_work_{false},
-			work_ready_{false} {
+			base_de_{base_de}, pool_(pool), generated_{false},
+			initialized_{false}, work_ready_{true} {
 
-		population_.resize(kPopSize_);
+		const int dim = base_de_->kDim_;
+		population_.assign(kPopSize_, CandidateTraits<POP_TYPE,POP_DIM>::make(dim));
+		pop_candidate_ = CandidateTraits<POP_TYPE,POP_DIM>::make(dim);
+		std::get<1>(best_candidate_) = CandidateTraits<POP_TYPE,POP_DIM>::make(dim);
 		pop_errors_.resize(kPopSize_);
-		
-		using MyThreadsDESolver =
-			pdebc::ThreadsDESolver<POP_TYPE,POP_DIM,ERROR_TYPE>;
-		thread_ = std::thread(&MyThreadsDESolver::run,this);
 	}
 	~ThreadsDESolver() {
-		std::unique_lock<std::mutex> lock(mutex_);
-		pending_work_ = true;
-		finish_ = true;
-		cond_.notify_one();
-		lock.unlock();
-		thread_.join();
+		waitWork();
 	}
 
 	void solveOneGeneration() {
-		using namespace std;
-		unique_lock<mutex> lock(mutex_);
-		pending_work_ = true;
-		work_ready_ = false;
-		work_type_ = WorkType::SOLVE_GENERATION;
-		cond_.notify_one();
+		submitWork(WorkType::SOLVE_GENERATION);
 	}
 
 	void solveBestCandidate() {
-		using namespace std;
-		unique_lock<mutex> lock(mutex_);
-		pending_work_ = true;
-		work_ready_ = false;
-		work_type_ = WorkType::GET_BEST_CANDIDATE;
-		cond_.notify_one();
+		submitWork(WorkType::GET_BEST_CANDIDATE);
 	}
 
-	std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>> getBestCandidate() const {
+	void solveReevaluation() {
+		submitWork(WorkType::REEVALUATE_POPULATION);
+	}
+
+	std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>> getBestCandidate() const {
 		return best_candidate_;
 	}
 
+	//! Seeds the engines and generates the island, on the calling thread.
+	/*!
+		Only call it before the first task. Does nothing the second time.
+	*/
+	void generate() {
+		using namespace std;
+		if (generated_) {
+			return;
+		}
+		// Every island derives its engines from the DE seed and its ID
+		seed_seq seq{static_cast<uint32_t>(base_de_->kSeed_),
+			static_cast<uint32_t>(base_de_->kSeed_ >> 32),
+			static_cast<uint32_t>(kID_)};
+		array<uint32_t, 3> seeds;
+		seq.generate(seeds.begin(), seeds.end());
+
+		// Initialize random_cr_
+		mt19937 emt(seeds[0]);
+		uniform_real_distribution<double> ud(0.0, 1.0);
+		random_cr_ = bind(ud, emt);
+
+		// Initialize random_trials_
+		mt19937 emt2(seeds[1]);
+		uniform_int_distribution<uint32_t> ui2(0, kPopSize_-1);
+		random_trials_ = bind(ui2, emt2);
+
+		// Initialize random_j_
+		mt19937 emt3(seeds[2]);
+		uniform_int_distribution<uint32_t> ui3(0, base_de_->kDim_-1);
+		random_j_ = bind(ui3, emt3);
+
+		generatePopulation();
+		generated_ = true;
+	}
+
+	//! Replaces member `index` of the island by a migrant from another island.
+	/*!
+		Only call it between waitWork() and the next task.
+	*/
+	void immigrate(const uint32_t index,
+		const std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>>& migrant) {
+		pop_errors_[index] = std::get<0>(migrant);
+		population_[index] = std::get<1>(migrant);
+	}
+
+	//! Replaces the worst member of the island, on the calling thread.
+	/*!
+		Only call it between waitWork() and the next task.
+	*/
+	void inject(const Candidate<POP_TYPE,POP_DIM>& candidate) {
+		if (!initialized_) {
+			initialize();
+		}
+		pop_candidate_ = candidate;
+		const ERROR_TYPE error = base_de_->callback_calc_error_(pop_candidate_);
+		kernels::replaceWorst(pop_candidate_, error, population_, pop_errors_,
+			base_de_->callback_error_evaluation_);
+	}
+
 	void waitWork() {
 		using namespace std;
 		unique_lock<mutex> lock(work_ready_lock_);
-		work_ready_cond_.wait(lock, [this]() {return this->work_ready_;});
+		while (!work_ready_) {
+			// Help the pool while our task is queued, so waiting from a
+			// pool thread (or on a pool smaller than the islands) can't deadlock
+			lock.unlock();
+			const bool helped = pool_.runPendingTask();
+			lock.lock();
+			if (!helped) {
+				// our task is already running somewhere
+				work_ready_cond_.wait(lock, [this]() {return this->work_ready_;});
+			}
+		}
+	}
+
+	void execute() {
+		const bool fresh = !initialized_;
+		if (fresh) {
+			initialize();
+		}
+
+		if (work_type_ == WorkType::SOLVE_GENERATION) {
+			for (uint32_t i = 0; i < kPopSize_; ++i) {
+				mutation(i);
+				select(i);
+			}
+		} else if (work_type_ == WorkType::GET_BEST_CANDIDATE) {
+			const uint32_t min = kernels::bestCandidateIndex(
+				pop_errors_, base_de_->callback_error_evaluation_);
+
+			// element-wise, so a kDynamicDim candidate reuses its storage
+			std::get<0>(best_candidate_) = pop_errors_[min];
+			std::get<1>(best_candidate_) = population_[min];
+		} else if (work_type_ == WorkType::REEVALUATE_POPULATION && !fresh) {
+			calcGenerationError();
+		}
+
+		// Lets tell everyone we are DONE! <sigh>
+		std::lock_guard<std::mutex> work_read_lock(work_ready_lock_);
+		work_ready_ = true;
+		work_ready_cond_.notify_all();
 	}
 
 private:
@@ -104,92 +197,41 @@ private:
 	std::function<uint32_t()> random_trials_;
 	std::function<uint32_t()> random_j_;
 
-	template <class T, unsigned I, unsigned J>
-	using Matrix = std::array<std::array<T, J>, I>;
-
-	Matrix<POP_TYPE, 3, POP_DIM> pop_trials_; // Used in "mutation"
-
-	std::array<POP_TYPE, POP_DIM> pop_candidate_;
+	Candidate<POP_TYPE,POP_DIM> pop_candidate_;
 	std::vector<ERROR_TYPE> pop_errors_;
 
-	std::tuple<ERROR_TYPE,std::array<POP_TYPE,POP_DIM>> best_candidate_;
+	std::tuple<ERROR_TYPE,Candidate<POP_TYPE,POP_DIM>> best_candidate_;
 
 	// Threads Flow Control
-	std::thread thread_;
-	std::mutex mutex_;
-	std::condition_variable cond_;
-	bool pending_work_;
-	bool finish_;
+	ThreadPool& pool_;
+	bool generated_;
+	bool initialized_;
 	bool work_ready_;
 	WorkType work_type_;
 	std::mutex work_ready_lock_;
 	std::condition_variable work_ready_cond_;
 
-	void run() {
-
-		using namespace std;
-		{ // this scope will be called only once
-			// Initialize random_cr_
-			mt19937 emt(random_device{}());
-			uniform_real_distribution<double> ud(0.0, 1.0);
-			random_cr_ = bind(ud, emt);
-
-			// Initialize random_trials_
-			mt19937 emt2(random_device{}());
-			uniform_int_distribution<uint32_t> ui2(0, kPopSize_-1);
-			random_trials_ = bind(ui2, emt2);
-
-			// Initialize random_j_
-			mt19937 emt3(random_device{}());
-			uniform_int_distribution<uint32_t> ui3(0, POP_DIM-1);
-			random_j_ = bind(ui3, emt3);
-
-			generatePopulation();
-			calcGenerationError();
+	void submitWork(const WorkType type) {
+		// a solver is queued at most once at a time
+		waitWork();
+		{
+			std::lock_guard<std::mutex> lock(work_ready_lock_);
+			work_ready_ = false;
 		}
+		work_type_ = type;
+		pool_.submit(this);
+	}
 
-		while (!finish_) {
-			// non-busy wait for more work
-			unique_lock<mutex> lock(mutex_);
-			cond_.wait(lock, [this]() {
-				return this->pending_work_;
-			});
-			lock.unlock();
-
-			if (finish_) {
-				continue;
-			}
-
-
-			if (work_type_ == WorkType::SOLVE_GENERATION) {
-				for (uint32_t i = 0; i < kPopSize_; ++i) {
-					mutation(i);
-					select(i);
-				}
-			} else if (work_type_ == WorkType::GET_BEST_CANDIDATE) {
-				auto e = std::min_element(pop_errors_.begin(),
-					pop_errors_.end(),
-					base_de_->callback_error_evaluation_);
-
-				auto min = std::distance(pop_errors_.begin(), e);
-				std::array<POP_TYPE,POP_DIM> r = population_[min];
-
-				best_candidate_ = make_tuple(pop_errors_[min],r);
-			}
-
-
-			// Lets tell everyone we are DONE! <sigh>
-			///   Need a full cycle to call it done!
-			pending_work_ = false;
-			lock_guard<mutex> work_read_lock(work_ready_lock_);
-			work_ready_ = true;
-			work_ready_cond_.notify_one();
-		}
+	// Runs once, from the first task
+	void initialize() {
+		generate();
+		calcGenerationError();
+		initialized_ = true;
 	}
 
 	void generatePopulation() {
 		for (uint32_t i = 0; i < kPopSize_; ++i) {
-			for (int d = 0; d < POP_DIM; ++d) {
+			for (int d = 0; d < base_de_->kDim_; ++d) {
 				population_[i][d] =
 					base_de_->callback_population_generator_();
 			}
@@ -198,60 +240,29 @@ private:
 
 	void calcGenerationError() {
 		for (uint32_t i = 0; i < kPopSize_; ++i) {
-			for (int d = 0; d < POP_DIM; ++d) {
-				pop_candidate_[d] = population_[i][d];
-			}
+			pop_candidate_ = population_[i];
 			pop_errors_[i] = 
 				base_de_->callback_calc_error_(pop_candidate_);
 		}
 	}
 
 	void mutation(const uint32_t actual_index) {
-		int j = random_j_();
+		const int j = random_j_();
 
-		const uint32_t it0 = random_trials_();
-		uint32_t it1 = random_trials_();
-		while (it1 == it0) {
-			it1 = random_trials_();
-		}
-		uint32_t it2 = random_trials_();
-		while (it2 == it1 || it2 == it0) {
-			it2 = random_trials_();
-		}
+		uint32_t it0, it1, it2;
+		kernels::sampleDistinctIndices(random_trials_, it0, it1, it2);
 
-		pop_trials_[0] = population_[it0];
-		pop_trials_[1] = population_[it1];
-		pop_trials_[2] = population_[it2];
-
-		pop_candidate_[j] = pop_trials_[0][j] + base_de_->kF_
-			* (pop_trials_[1][j] - pop_trials_[2][j]);
-		j = (j + 1) % POP_DIM;
-
-		for (int k = 1; k < POP_DIM; ++k) {
-			if (random_cr_() <= base_de_->kCR_) {
-				pop_candidate_[j] = pop_trials_[0][j]
-					+ base_de_->kF_ * (pop_trials_[1][j]
-					- pop_trials_[2][j]);
-		    } else {
-		      	pop_candidate_[j] = population_[actual_index][j];
-		    }
-		    j = (j + 1) % POP_DIM;
-	    }
+		kernels::buildTrial<POP_TYPE,POP_DIM>(population_[actual_index],
+			population_[it0], population_[it1], population_[it2],
+			base_de_->kF_, base_de_->kCR_, j, random_cr_,
+			pop_candidate_);
 	}
 	
 
 	void select(const uint32_t actual_index) {
-		ERROR_TYPE error_new = base_de_->callback_calc_error_(
-				pop_candidate_);
-
-		if (base_de_->callback_error_evaluation_(
-				error_new, pop_errors_[actual_index])) {
-			for (int d = 0; d < POP_DIM; d++) {
-				population_[actual_index][d] =
-					pop_candidate_[d];
-			}
-			pop_errors_[actual_index] = error_new;
-		}
+		kernels::selectTrial(actual_index, pop_candidate_, population_,
+			pop_errors_, base_de_->callback_calc_error_,
+			base_de_->callback_error_evaluation_);
 	}
 };
 